@@ -0,0 +1,304 @@
+// microbenchmarks for the locks and queues, built as the separate `bench` target
+// usage: bench [--threads N] [--ops N] [--filter name]
+//   sweeps 1..N threads (powers of two), read ratios for the reader-writer locks and payload sizes,
+//   and prints throughput, per-op latency percentiles and cache misses when perf counters are available
+#include "lock.h"
+#include "concurrent_queue.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using bench_clock = std::chrono::steady_clock;
+
+// hardware cache miss counter for the calling thread and the threads it spawns afterwards
+class cache_miss_counter
+{
+    int m_fd = -1;
+public:
+    cache_miss_counter()
+    {
+#if defined(__linux__)
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    ~cache_miss_counter()
+    {
+#if defined(__linux__)
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+    // counts of spawned threads are folded in when they exit, so read after joining them
+    std::optional<uint64_t> read()
+    {
+#if defined(__linux__)
+        uint64_t value = 0;
+        if (m_fd >= 0 && ::read(m_fd, &value, sizeof(value)) == sizeof(value)) return value;
+#endif
+        return std::nullopt;
+    }
+};
+
+struct result
+{
+    std::string name;
+    unsigned threads;
+    int read_percent;
+    size_t payload;
+    uint64_t ops;
+    double seconds;
+    std::vector<uint32_t> latencies; // nanoseconds, sampled per op
+    std::optional<uint64_t> cache_misses;
+};
+
+void print_header()
+{
+    std::cout << std::left << std::setw(28) << "benchmark" << std::right
+        << std::setw(8) << "threads" << std::setw(7) << "read%" << std::setw(9) << "payload"
+        << std::setw(14) << "Mops/s" << std::setw(9) << "p50ns" << std::setw(9) << "p99ns" << std::setw(10) << "p99.9ns"
+        << std::setw(14) << "misses/op" << std::endl;
+}
+
+void print(result& r)
+{
+    std::sort(r.latencies.begin(), r.latencies.end());
+    auto percentile = [&](double p) -> uint32_t
+    {
+        if (r.latencies.empty()) return 0;
+        return r.latencies[std::min(r.latencies.size() - 1, static_cast<size_t>(p * r.latencies.size()))];
+    };
+    std::cout << std::left << std::setw(28) << r.name << std::right
+        << std::setw(8) << r.threads << std::setw(7) << r.read_percent << std::setw(9) << r.payload
+        << std::setw(14) << std::fixed << std::setprecision(3) << r.ops / r.seconds / 1e6
+        << std::setw(9) << percentile(0.5) << std::setw(9) << percentile(0.99) << std::setw(10) << percentile(0.999);
+    if (r.cache_misses)
+        std::cout << std::setw(14) << std::setprecision(2) << static_cast<double>(*r.cache_misses) / r.ops;
+    else
+        std::cout << std::setw(14) << "n/a";
+    std::cout << std::endl;
+}
+
+// runs body(thread_index, latencies) on n threads released together, returns the wall time. body records one
+// latency per completed operation, which is what throughput is computed from
+template<typename Body>
+result run(const std::string& name, unsigned n_threads, int read_percent, size_t payload, uint64_t ops_per_thread, Body body)
+{
+    std::vector<std::vector<uint32_t>> latencies(n_threads);
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    cache_miss_counter misses;
+    for (unsigned t = 0; t < n_threads; ++t)
+    {
+        latencies[t].reserve(ops_per_thread);
+        threads.emplace_back([&, t]()
+        {
+            ready++;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            body(t, latencies[t]);
+        });
+    }
+    while (ready.load() < n_threads) std::this_thread::yield();
+    auto start = bench_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    result r{name, n_threads, read_percent, payload, 0, seconds, {}, misses.read()};
+    for (auto& l : latencies) r.latencies.insert(r.latencies.end(), l.begin(), l.end());
+    r.ops = r.latencies.size();
+    return r;
+}
+
+template<typename Lock>
+void lock_shared(Lock& mu)
+{
+    if constexpr (requires { mu.lock_read(); }) mu.lock_read();
+    else if constexpr (requires { mu.lock_shared(); }) mu.lock_shared();
+    else mu.lock();
+}
+
+template<typename Lock>
+void unlock_shared(Lock& mu)
+{
+    if constexpr (requires { mu.unlock_read(); }) mu.unlock_read();
+    else if constexpr (requires { mu.unlock_shared(); }) mu.unlock_shared();
+    else mu.unlock();
+}
+
+template<typename Lock>
+void lock_exclusive(Lock& mu)
+{
+    if constexpr (requires { mu.lock_write(); }) mu.lock_write();
+    else mu.lock();
+}
+
+template<typename Lock>
+void unlock_exclusive(Lock& mu)
+{
+    if constexpr (requires { mu.unlock_write(); }) mu.unlock_write();
+    else mu.unlock();
+}
+
+// critical section reads or rewrites `payload` bytes of shared state
+template<typename Lock>
+result bench_lock(const std::string& name, unsigned n_threads, int read_percent, size_t payload, uint64_t ops)
+{
+    Lock mu;
+    std::vector<unsigned char> shared(payload, 0);
+    return run(name, n_threads, read_percent, payload, ops, [&](unsigned t, std::vector<uint32_t>& latencies)
+    {
+        std::vector<unsigned char> local(payload);
+        uint64_t rng = 0x9e3779b97f4a7c15ull * (t + 1);
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+            bool read = static_cast<int>(rng % 100) < read_percent;
+            auto start = bench_clock::now();
+            if (read)
+            {
+                lock_shared(mu);
+                std::memcpy(local.data(), shared.data(), payload);
+                unlock_shared(mu);
+            }
+            else
+            {
+                lock_exclusive(mu);
+                std::memset(shared.data(), static_cast<int>(i), payload);
+                unlock_exclusive(mu);
+            }
+            latencies.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count()));
+        }
+    });
+}
+
+template<size_t Size>
+struct payload_t
+{
+    std::array<unsigned char, Size> bytes{};
+};
+
+// half of the threads push, the other half pop, latency is measured per successful operation. needs 2 threads
+template<typename Queue, size_t Size>
+result bench_queue(const std::string& name, unsigned n_threads, uint64_t ops)
+{
+    Queue q;
+    unsigned producers = n_threads / 2;
+    std::atomic<uint64_t> remaining{ops * producers};
+    return run(name, n_threads, 0, Size, ops, [&](unsigned t, std::vector<uint32_t>& latencies)
+    {
+        if (t < producers)
+        {
+            for (uint64_t i = 0; i < ops; ++i)
+            {
+                auto start = bench_clock::now();
+                q.push(payload_t<Size>{});
+                latencies.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count()));
+            }
+        }
+        else
+        {
+            while (remaining.load(std::memory_order_relaxed) > 0)
+            {
+                auto start = bench_clock::now();
+                if (q.pop())
+                {
+                    latencies.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count()));
+                    remaining.fetch_sub(1, std::memory_order_relaxed);
+                }
+                else std::this_thread::yield();
+            }
+        }
+    });
+}
+
+template<size_t Size>
+void bench_queues(unsigned n_threads, uint64_t ops, const std::string& filter)
+{
+    auto wanted = [&](const std::string& name) { return filter.empty() || name.find(filter) != std::string::npos; };
+    using payload = payload_t<Size>;
+    std::vector<result> results;
+    if (wanted("concurrent_queue")) results.push_back(bench_queue<concurrent_queue<payload>, Size>("concurrent_queue", n_threads, ops));
+    if (wanted("concurrent_queue<mutex>")) results.push_back(bench_queue<concurrent_queue<payload, std::deque<payload>, std::mutex>, Size>("concurrent_queue<mutex>", n_threads, ops));
+    if (wanted("mpmc_queue")) results.push_back(bench_queue<mpmc_queue<payload>, Size>("mpmc_queue", n_threads, ops));
+    if (wanted("segmented_queue")) results.push_back(bench_queue<segmented_queue<payload>, Size>("segmented_queue", n_threads, ops));
+    for (auto& r : results) print(r);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t ops = 100000;
+    std::string filter;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads") max_threads = std::stoul(argv[i + 1]);
+        else if (arg == "--ops") ops = std::stoull(argv[i + 1]);
+        else if (arg == "--filter") filter = argv[i + 1];
+    }
+    auto wanted = [&](const std::string& name) { return filter.empty() || name.find(filter) != std::string::npos; };
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned n = 1; n < max_threads; n *= 2) thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    print_header();
+    for (size_t payload : {8, 64, 512})
+    {
+        for (int read_percent : {0, 90, 99})
+        {
+            for (unsigned n : thread_counts)
+            {
+                std::vector<result> results;
+                if (wanted("spinlock")) results.push_back(bench_lock<spinlock>("spinlock", n, read_percent, payload, ops));
+                if (wanted("adaptive_lock")) results.push_back(bench_lock<adaptive_lock>("adaptive_lock", n, read_percent, payload, ops));
+                if (wanted("ticket_lock")) results.push_back(bench_lock<ticket_lock>("ticket_lock", n, read_percent, payload, ops));
+                if (wanted("mcs_lock")) results.push_back(bench_lock<mcs_lock>("mcs_lock", n, read_percent, payload, ops));
+                if (wanted("std::mutex")) results.push_back(bench_lock<std::mutex>("std::mutex", n, read_percent, payload, ops));
+                if (wanted("rwlock")) results.push_back(bench_lock<rwlock>("rwlock", n, read_percent, payload, ops));
+                if (wanted("distributed_rwlock")) results.push_back(bench_lock<distributed_rwlock>("distributed_rwlock", n, read_percent, payload, ops));
+                if (wanted("std::shared_mutex")) results.push_back(bench_lock<std::shared_mutex>("std::shared_mutex", n, read_percent, payload, ops));
+                for (auto& r : results) print(r);
+            }
+        }
+    }
+    // a queue needs a producer and a consumer, smaller thread counts are skipped rather than run as 2
+    for (unsigned n : thread_counts)
+    {
+        if (n < 2) continue;
+        bench_queues<8>(n, ops, filter);
+        bench_queues<64>(n, ops, filter);
+        bench_queues<512>(n, ops, filter);
+    }
+    return 0;
+}
@@ -1,17 +1,115 @@
 #pragma once
 #include "lock.h"
+#include "epoch.h"
+#include "pool_allocator.h"
 
 #include <queue>
 #include <functional>
 #include <mutex>
 #include <optional>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <new>
+#include <algorithm>
+#include <ranges>
+#include <vector>
+#include <utility>
 
-template<typename T, typename Container = std::deque<T>>
+// growable circular buffer usable as the Container of std::queue/concurrent_queue
+// unlike std::deque it keeps its storage when drained, so a queue that has reached its working size
+// stops allocating
+template<typename T>
+class ring_buffer
+{
+    T* m_data = nullptr;
+    size_t m_capacity = 0;
+    size_t m_head = 0;
+    size_t m_size = 0;
+
+    void grow()
+    {
+        size_t capacity = m_capacity ? m_capacity * 2 : 16;
+        task_path_allocations.fetch_add(1, std::memory_order_relaxed);
+        T* data = static_cast<T*>(::operator new(capacity * sizeof(T), std::align_val_t(alignof(T))));
+        for (size_t i = 0; i < m_size; ++i)
+        {
+            T& value = m_data[(m_head + i) & (m_capacity - 1)];
+            new (data + i) T(std::move(value));
+            value.~T();
+        }
+        ::operator delete(m_data, std::align_val_t(alignof(T)));
+        m_data = data;
+        m_capacity = capacity;
+        m_head = 0;
+    }
+
+public:
+    using value_type = T;
+    using reference = T&;
+    using const_reference = const T&;
+    using size_type = size_t;
+
+    ring_buffer() = default;
+    ring_buffer(ring_buffer&& other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr)), m_capacity(std::exchange(other.m_capacity, 0)),
+        m_head(std::exchange(other.m_head, 0)), m_size(std::exchange(other.m_size, 0))
+    {
+    }
+    ring_buffer& operator=(ring_buffer&& other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+    ~ring_buffer()
+    {
+        while (m_size) pop_front();
+        ::operator delete(m_data, std::align_val_t(alignof(T)));
+    }
+
+    void swap(ring_buffer& other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_head, other.m_head);
+        std::swap(m_size, other.m_size);
+    }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+
+    T& front() { return m_data[m_head]; }
+    const T& front() const { return m_data[m_head]; }
+    T& back() { return m_data[(m_head + m_size - 1) & (m_capacity - 1)]; }
+    const T& back() const { return m_data[(m_head + m_size - 1) & (m_capacity - 1)]; }
+
+    template< class... Args >
+    T& emplace_back( Args&&... args )
+    {
+        if (m_size == m_capacity) grow();
+        T* slot = m_data + ((m_head + m_size) & (m_capacity - 1));
+        new (slot) T(std::forward<Args>(args)...);
+        ++m_size;
+        return *slot;
+    }
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_front()
+    {
+        m_data[m_head].~T();
+        m_head = (m_head + 1) & (m_capacity - 1);
+        --m_size;
+    }
+};
+
+// Lock can be any type with lock()/unlock(): spinlock, adaptive_lock, std::mutex...
+template<typename T, typename Container = std::deque<T>, typename Lock = spinlock>
 class concurrent_queue
 {
     std::queue<T, Container> queue;
-    // using lock_type = std::mutex;
-    using lock_type = spinlock;
+    using lock_type = Lock;
     lock_type mu;
 
     template<typename LockType>
@@ -52,7 +150,7 @@ public:
     void push(T&& value)
     {
         scope_lock<lock_type> l(mu);
-        queue.push(value);
+        queue.push(std::move(value));
     }
 
     void push(const T& value)
@@ -65,7 +163,7 @@ public:
     {
         {
             scope_lock<lock_type> l(mu);
-            queue.push(value);
+            queue.push(std::move(value));
         }
         fn();
     }
@@ -79,22 +177,875 @@ public:
         fn();
     }
 
+    // pushes the whole range under one lock acquisition, elements are moved when the range is an rvalue
+    template<std::ranges::input_range R>
+    size_t push_bulk(R&& r)
+    {
+        size_t n = 0;
+        scope_lock<lock_type> l(mu);
+        for (auto&& value : r)
+        {
+            if constexpr (std::is_lvalue_reference_v<R>) queue.push(value);
+            else queue.push(std::move(value));
+            ++n;
+        }
+        return n;
+    }
+
+    // fn is called once, outside the lock, with the number of elements pushed
+    template<std::ranges::input_range R>
+    void push_bulk_and_notify(R&& r, const std::function<void(size_t)>& fn)
+    {
+        size_t n = push_bulk(std::forward<R>(r));
+        if (n) fn(n);
+    }
+
     std::optional<T> pop()
     {
         scope_lock<lock_type> l(mu);
         if (!queue.empty())
         {
-            auto front = queue.front();
+            std::optional<T> front(std::move(queue.front()));
             queue.pop();
             return front;
         }
         else return std::nullopt;
     }
 
+    // moves up to max elements into out under one lock acquisition, returns how many were popped
+    template<typename OutputIterator>
+    size_t pop_bulk(OutputIterator out, size_t max)
+    {
+        scope_lock<lock_type> l(mu);
+        size_t n = 0;
+        for (; n < max && !queue.empty(); ++n)
+        {
+            *out++ = std::move(queue.front());
+            queue.pop();
+        }
+        return n;
+    }
+
+    // takes every queued element, the lock is only held to swap the underlying queue out
+    std::vector<T> drain()
+    {
+        std::queue<T, Container> taken;
+        {
+            scope_lock<lock_type> l(mu);
+            std::swap(taken, queue);
+        }
+        std::vector<T> values;
+        values.reserve(taken.size());
+        for (; !taken.empty(); taken.pop())
+            values.push_back(std::move(taken.front()));
+        return values;
+    }
+
     template< class... Args >
     decltype(auto) emplace( Args&&... args )
     {
         scope_lock<lock_type> l(mu);
-        queue.emplace(args...);
+        queue.emplace(std::forward<Args>(args)...);
+    }
+};
+
+// bounded multi-producer/multi-consumer ring buffer (Dmitry Vyukov's design)
+// every slot carries a sequence number telling producers and consumers whose turn it is,
+// so try_push/try_pop only CAS the head or tail index and never take a lock
+template<typename T>
+class mpmc_queue
+{
+    struct slot
+    {
+        std::atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* ptr() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<slot[]> m_slots;
+    alignas(cache_line_size) std::atomic<size_t> m_tail{0};
+    alignas(cache_line_size) std::atomic<size_t> m_head{0};
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        return n;
+    }
+
+public:
+    explicit mpmc_queue(size_t capacity = 1024) : m_mask(round_up(capacity) - 1), m_slots(new slot[m_mask + 1])
+    {
+        for (size_t i = 0; i <= m_mask; ++i)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    ~mpmc_queue()
+    {
+        while (try_pop());
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    // approximate when other threads are pushing or popping concurrently
+    size_t size() const
+    {
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    template< class... Args >
+    bool try_emplace(Args&&... args)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        slot* s;
+        while (true)
+        {
+            s = &m_slots[pos & m_mask];
+            size_t seq = s->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) return false; // full
+            else pos = m_tail.load(std::memory_order_relaxed);
+        }
+        new (s->storage) T(std::forward<Args>(args)...);
+        s->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(T&& value) { return try_emplace(std::move(value)); }
+    bool try_push(const T& value) { return try_emplace(value); }
+
+    std::optional<T> try_pop()
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        slot* s;
+        while (true)
+        {
+            s = &m_slots[pos & m_mask];
+            size_t seq = s->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) return std::nullopt; // empty
+            else pos = m_head.load(std::memory_order_relaxed);
+        }
+        std::optional<T> value(std::move(*s->ptr()));
+        s->ptr()->~T();
+        s->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return value;
+    }
+
+    // same surface as concurrent_queue: push waits for a free slot when the ring is full, pop never waits
+    template< class... Args >
+    void emplace( Args&&... args )
+    {
+        while (!try_emplace(std::forward<Args>(args)...))
+            std::this_thread::yield();
+    }
+
+    void push(T&& value) { emplace(std::move(value)); }
+    void push(const T& value) { emplace(value); }
+
+    void push_and_notify(T&& value, const std::function<void()>& fn)
+    {
+        emplace(std::move(value));
+        fn();
+    }
+
+    void push_and_notify(const T& value, const std::function<void()>& fn)
+    {
+        emplace(value);
+        fn();
+    }
+
+    std::optional<T> pop() { return try_pop(); }
+
+    template<std::ranges::input_range R>
+    size_t push_bulk(R&& r)
+    {
+        size_t n = 0;
+        for (auto&& value : r)
+        {
+            if constexpr (std::is_lvalue_reference_v<R>) emplace(value);
+            else emplace(std::move(value));
+            ++n;
+        }
+        return n;
+    }
+
+    template<std::ranges::input_range R>
+    void push_bulk_and_notify(R&& r, const std::function<void(size_t)>& fn)
+    {
+        size_t n = push_bulk(std::forward<R>(r));
+        if (n) fn(n);
+    }
+
+    template<typename OutputIterator>
+    size_t pop_bulk(OutputIterator out, size_t max)
+    {
+        size_t n = 0;
+        for (; n < max; ++n)
+        {
+            auto value = try_pop();
+            if (!value) break;
+            *out++ = std::move(*value);
+        }
+        return n;
+    }
+
+    std::vector<T> drain()
+    {
+        std::vector<T> values;
+        while (auto value = try_pop())
+            values.push_back(std::move(*value));
+        return values;
+    }
+};
+
+// bounded single-producer/single-consumer ring buffer
+// each side keeps a private copy of the other side's index and only reloads it when the ring looks full/empty,
+// so the fast path is one relaxed load and one release store, no read-modify-write
+template<typename T>
+class spsc_queue
+{
+    struct slot
+    {
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* ptr() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<slot[]> m_slots;
+    // producer side
+    alignas(cache_line_size) std::atomic<size_t> m_tail{0};
+    size_t m_cached_head{0};
+    // consumer side
+    alignas(cache_line_size) std::atomic<size_t> m_head{0};
+    size_t m_cached_tail{0};
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        return n;
+    }
+
+    size_t free_slots(size_t tail)
+    {
+        if (tail - m_cached_head > m_mask)
+            m_cached_head = m_head.load(std::memory_order_acquire);
+        return m_mask + 1 - (tail - m_cached_head);
+    }
+
+    size_t available(size_t head)
+    {
+        if (head == m_cached_tail)
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+        return m_cached_tail - head;
+    }
+
+public:
+    explicit spsc_queue(size_t capacity = 1024) : m_mask(round_up(capacity) - 1), m_slots(new slot[m_mask + 1]) {}
+
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    ~spsc_queue()
+    {
+        while (try_pop());
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    size_t size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+
+    bool empty() const { return size() == 0; }
+
+    // producer only
+    template< class... Args >
+    bool try_emplace(Args&&... args)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (free_slots(tail) == 0) return false;
+        new (m_slots[tail & m_mask].storage) T(std::forward<Args>(args)...);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(T&& value) { return try_emplace(std::move(value)); }
+    bool try_push(const T& value) { return try_emplace(value); }
+
+    // producer only: constructs as many elements of [first, last) as fit and publishes them with one release store
+    // returns the iterator to the first element that was not written
+    template<typename Iterator>
+    Iterator write_batch(Iterator first, Iterator last)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t n = free_slots(tail), written = 0;
+        for (; first != last && written < n; ++first, ++written)
+            new (m_slots[(tail + written) & m_mask].storage) T(*first);
+        if (written) m_tail.store(tail + written, std::memory_order_release);
+        return first;
+    }
+
+    // consumer only
+    std::optional<T> try_pop()
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (available(head) == 0) return std::nullopt;
+        T* p = m_slots[head & m_mask].ptr();
+        std::optional<T> value(std::move(*p));
+        p->~T();
+        m_head.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    // consumer only: moves up to max elements into out and releases their slots with one store
+    template<typename OutputIterator>
+    size_t read_batch(OutputIterator out, size_t max)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t n = std::min(available(head), max);
+        for (size_t i = 0; i < n; ++i)
+        {
+            T* p = m_slots[(head + i) & m_mask].ptr();
+            *out++ = std::move(*p);
+            p->~T();
+        }
+        if (n) m_head.store(head + n, std::memory_order_release);
+        return n;
+    }
+};
+
+
+// unbounded multi-producer/multi-consumer queue made of linked array segments
+// producers and consumers claim slots with a fetch_add on the segment's indices, a new segment is linked
+// when the tail one is full, and drained head segments are handed to the epoch_domain for reclamation
+template<typename T, size_t SegmentSize = 64>
+class segmented_queue
+{
+    enum slot_state : uint8_t { vacant, writing, full, taken };
+
+    struct slot
+    {
+        std::atomic<uint8_t> state{vacant};
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* ptr() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    struct segment
+    {
+        alignas(cache_line_size) std::atomic<size_t> enqueue_index{0};
+        alignas(cache_line_size) std::atomic<size_t> dequeue_index{0};
+        std::atomic<segment*> next{nullptr};
+        slot slots[SegmentSize];
+
+        ~segment()
+        {
+            for (auto& s : slots)
+                if (s.state.load(std::memory_order_relaxed) == full) s.ptr()->~T();
+        }
+    };
+
+    alignas(cache_line_size) std::atomic<segment*> m_head;
+    alignas(cache_line_size) std::atomic<segment*> m_tail;
+
+    static void delete_segment(void* p) { delete static_cast<segment*>(p); }
+
+public:
+    segmented_queue()
+    {
+        segment* s = new segment;
+        m_head.store(s, std::memory_order_relaxed);
+        m_tail.store(s, std::memory_order_relaxed);
+    }
+
+    segmented_queue(const segmented_queue&) = delete;
+    segmented_queue& operator=(const segmented_queue&) = delete;
+
+    ~segmented_queue()
+    {
+        segment* s = m_head.load(std::memory_order_relaxed);
+        while (s)
+        {
+            segment* next = s->next.load(std::memory_order_relaxed);
+            delete s;
+            s = next;
+        }
+    }
+
+    // never fails and never blocks other producers, a full tail segment is extended instead
+    template< class... Args >
+    void emplace( Args&&... args )
+    {
+        epoch_guard guard;
+        while (true)
+        {
+            segment* tail = m_tail.load(std::memory_order_acquire);
+            size_t idx = tail->enqueue_index.fetch_add(1, std::memory_order_relaxed);
+            if (idx < SegmentSize)
+            {
+                slot& s = tail->slots[idx];
+                uint8_t expected = vacant;
+                // a consumer that overtook us marks the slot taken, then we just try another one
+                if (s.state.compare_exchange_strong(expected, writing, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    new (s.storage) T(std::forward<Args>(args)...);
+                    s.state.store(full, std::memory_order_release);
+                    return;
+                }
+                continue;
+            }
+            if (tail != m_tail.load(std::memory_order_acquire)) continue;
+            segment* next = tail->next.load(std::memory_order_acquire);
+            if (!next)
+            {
+                segment* fresh = new segment;
+                if (tail->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+                    next = fresh;
+                else
+                    delete fresh;
+            }
+            m_tail.compare_exchange_strong(tail, next, std::memory_order_acq_rel, std::memory_order_relaxed);
+        }
+    }
+
+    void push(T&& value) { emplace(std::move(value)); }
+    void push(const T& value) { emplace(value); }
+
+    bool try_push(T&& value) { emplace(std::move(value)); return true; }
+    bool try_push(const T& value) { emplace(value); return true; }
+
+    void push_and_notify(T&& value, const std::function<void()>& fn)
+    {
+        emplace(std::move(value));
+        fn();
+    }
+
+    void push_and_notify(const T& value, const std::function<void()>& fn)
+    {
+        emplace(value);
+        fn();
+    }
+
+    std::optional<T> try_pop()
+    {
+        epoch_guard guard;
+        while (true)
+        {
+            segment* head = m_head.load(std::memory_order_acquire);
+            if (head->dequeue_index.load(std::memory_order_acquire) >= head->enqueue_index.load(std::memory_order_acquire) &&
+                head->next.load(std::memory_order_acquire) == nullptr)
+                return std::nullopt;
+            size_t idx = head->dequeue_index.fetch_add(1, std::memory_order_acq_rel);
+            if (idx >= SegmentSize)
+            {
+                segment* next = head->next.load(std::memory_order_acquire);
+                if (!next) return std::nullopt;
+                // the tail must leave the segment before it is unlinked, it never moves back afterwards
+                segment* expected = head;
+                m_tail.compare_exchange_strong(expected, next, std::memory_order_acq_rel, std::memory_order_relaxed);
+                if (m_head.compare_exchange_strong(head, next, std::memory_order_acq_rel, std::memory_order_relaxed))
+                    epoch_domain::instance()->retire(head, delete_segment);
+                continue;
+            }
+            slot& s = head->slots[idx];
+            uint8_t state = vacant;
+            if (s.state.compare_exchange_strong(state, taken, std::memory_order_acquire, std::memory_order_acquire))
+                continue;
+            // the producer that owns this slot is constructing the element
+            while (state == writing)
+            {
+                std::this_thread::yield();
+                state = s.state.load(std::memory_order_acquire);
+            }
+            std::optional<T> value(std::move(*s.ptr()));
+            s.ptr()->~T();
+            s.state.store(taken, std::memory_order_relaxed);
+            return value;
+        }
+    }
+
+    std::optional<T> pop() { return try_pop(); }
+
+    // approximate when other threads are pushing or popping concurrently
+    bool empty()
+    {
+        epoch_guard guard;
+        segment* head = m_head.load(std::memory_order_acquire);
+        return head->dequeue_index.load(std::memory_order_acquire) >= std::min(head->enqueue_index.load(std::memory_order_acquire), SegmentSize) &&
+            head->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+    template<std::ranges::input_range R>
+    size_t push_bulk(R&& r)
+    {
+        size_t n = 0;
+        for (auto&& value : r)
+        {
+            if constexpr (std::is_lvalue_reference_v<R>) emplace(value);
+            else emplace(std::move(value));
+            ++n;
+        }
+        return n;
+    }
+
+    template<std::ranges::input_range R>
+    void push_bulk_and_notify(R&& r, const std::function<void(size_t)>& fn)
+    {
+        size_t n = push_bulk(std::forward<R>(r));
+        if (n) fn(n);
+    }
+
+    template<typename OutputIterator>
+    size_t pop_bulk(OutputIterator out, size_t max)
+    {
+        size_t n = 0;
+        for (; n < max; ++n)
+        {
+            auto value = try_pop();
+            if (!value) break;
+            *out++ = std::move(*value);
+        }
+        return n;
+    }
+
+    std::vector<T> drain()
+    {
+        std::vector<T> values;
+        while (auto value = try_pop())
+            values.push_back(std::move(*value));
+        return values;
+    }
+};
+
+
+enum class priority_ordering
+{
+    relaxed,
+    exact
+};
+
+// element with a separate priority/deadline key, compared on the key only
+template<typename T, typename Key = int>
+struct prioritized
+{
+    Key key;
+    T value;
+
+    friend bool operator<(const prioritized& a, const prioritized& b) { return a.key < b.key; }
+    friend bool operator>(const prioritized& a, const prioritized& b) { return b.key < a.key; }
+};
+
+// concurrent priority queue with std::priority_queue semantics: pop returns the element that compares greatest,
+// use std::greater<> to get the smallest key (e.g. earliest deadline) first
+// relaxed: a multi-queue of locked heaps, push goes to a random heap and pop takes the better top of two random heaps,
+//          elements come out in approximately priority order without a single contended lock
+// exact: a single locked heap, strict ordering for low thread counts
+template<typename T, typename Compare = std::less<T>>
+class concurrent_priority_queue
+{
+    struct alignas(cache_line_size) heap
+    {
+        spinlock mu;
+        std::priority_queue<T, std::vector<T>, Compare> queue;
+        std::atomic<size_t> size{0};
+    };
+
+    class scope_lock
+    {
+        spinlock& mu;
+        public:
+            scope_lock(spinlock& lock) : mu(lock) { mu.lock(); }
+            ~scope_lock() { mu.unlock(); }
+    };
+
+    size_t m_count;
+    std::unique_ptr<heap[]> m_heaps;
+    Compare m_compare;
+
+    static size_t random_index(size_t n)
+    {
+        thread_local uint64_t state = std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state % n;
+    }
+
+    heap& pick() { return m_heaps[m_count == 1 ? 0 : random_index(m_count)]; }
+
+    static std::optional<T> pop_locked(heap& h)
+    {
+        std::optional<T> top(std::move(const_cast<T&>(h.queue.top())));
+        h.queue.pop();
+        h.size.fetch_sub(1, std::memory_order_relaxed);
+        return top;
+    }
+
+    // takes from whichever heap still has elements so that pop only fails when everything looked empty
+    std::optional<T> pop_any()
+    {
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            heap& h = m_heaps[i];
+            if (h.size.load(std::memory_order_relaxed) == 0) continue;
+            scope_lock l(h.mu);
+            if (!h.queue.empty()) return pop_locked(h);
+        }
+        return std::nullopt;
+    }
+
+public:
+    explicit concurrent_priority_queue(priority_ordering ordering = priority_ordering::relaxed, size_t heaps_per_thread = 2)
+        : m_count(ordering == priority_ordering::exact ? 1 : std::max<size_t>(2, heaps_per_thread * std::max(1u, std::thread::hardware_concurrency()))),
+        m_heaps(new heap[m_count])
+    {
+    }
+
+    priority_ordering ordering() const { return m_count == 1 ? priority_ordering::exact : priority_ordering::relaxed; }
+
+    size_t size() const
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < m_count; ++i) n += m_heaps[i].size.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    template< class... Args >
+    void emplace( Args&&... args )
+    {
+        heap& h = pick();
+        scope_lock l(h.mu);
+        h.queue.emplace(std::forward<Args>(args)...);
+        h.size.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void push(T&& value) { emplace(std::move(value)); }
+    void push(const T& value) { emplace(value); }
+
+    bool try_push(T&& value) { emplace(std::move(value)); return true; }
+    bool try_push(const T& value) { emplace(value); return true; }
+
+    void push_and_notify(T&& value, const std::function<void()>& fn)
+    {
+        emplace(std::move(value));
+        fn();
+    }
+
+    void push_and_notify(const T& value, const std::function<void()>& fn)
+    {
+        emplace(value);
+        fn();
+    }
+
+    std::optional<T> try_pop()
+    {
+        if (m_count == 1)
+        {
+            scope_lock l(m_heaps[0].mu);
+            if (m_heaps[0].queue.empty()) return std::nullopt;
+            return pop_locked(m_heaps[0]);
+        }
+        for (int attempt = 0; attempt < 4; ++attempt)
+        {
+            heap& a = pick();
+            heap& b = pick();
+            if (&a == &b || !a.mu.try_lock()) continue;
+            if (!b.mu.try_lock())
+            {
+                a.mu.unlock();
+                continue;
+            }
+            heap* best = nullptr;
+            if (!a.queue.empty()) best = &a;
+            if (!b.queue.empty() && (!best || m_compare(best->queue.top(), b.queue.top()))) best = &b;
+            std::optional<T> value;
+            if (best) value = pop_locked(*best);
+            a.mu.unlock();
+            b.mu.unlock();
+            if (value) return value;
+        }
+        return pop_any();
+    }
+
+    std::optional<T> pop() { return try_pop(); }
+
+    // the batch lands in one heap under a single lock acquisition
+    template<std::ranges::input_range R>
+    size_t push_bulk(R&& r)
+    {
+        size_t n = 0;
+        heap& h = pick();
+        scope_lock l(h.mu);
+        for (auto&& value : r)
+        {
+            if constexpr (std::is_lvalue_reference_v<R>) h.queue.push(value);
+            else h.queue.push(std::move(value));
+            ++n;
+        }
+        h.size.fetch_add(n, std::memory_order_relaxed);
+        return n;
+    }
+
+    template<std::ranges::input_range R>
+    void push_bulk_and_notify(R&& r, const std::function<void(size_t)>& fn)
+    {
+        size_t n = push_bulk(std::forward<R>(r));
+        if (n) fn(n);
+    }
+
+    template<typename OutputIterator>
+    size_t pop_bulk(OutputIterator out, size_t max)
+    {
+        size_t n = 0;
+        for (; n < max; ++n)
+        {
+            auto value = try_pop();
+            if (!value) break;
+            *out++ = std::move(*value);
+        }
+        return n;
+    }
+
+    std::vector<T> drain()
+    {
+        std::vector<T> values;
+        while (auto value = try_pop())
+            values.push_back(std::move(*value));
+        return values;
+    }
+};
+
+
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli 2013)
+// the owner thread pushes and pops at the bottom (LIFO), any thread may steal from the top (FIFO)
+// T must be trivially copyable, typically a pointer. the ring grows on demand and old rings are retired through
+// the epoch_domain because a thief may still be reading from them
+template<typename T>
+class work_stealing_deque
+{
+    static_assert(std::is_trivially_copyable_v<T>, "work_stealing_deque stores elements in atomics");
+
+    struct ring
+    {
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit ring(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+        int64_t capacity() const { return mask + 1; }
+        T get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T value) { slots[i & mask].store(value, std::memory_order_relaxed); }
+    };
+
+    alignas(cache_line_size) std::atomic<int64_t> m_top{0};
+    alignas(cache_line_size) std::atomic<int64_t> m_bottom{0};
+    std::atomic<ring*> m_ring;
+
+    static void delete_ring(void* p) { delete static_cast<ring*>(p); }
+
+    ring* grow(ring* old, int64_t bottom, int64_t top)
+    {
+        task_path_allocations.fetch_add(1, std::memory_order_relaxed);
+        ring* bigger = new ring(old->capacity() * 2);
+        for (int64_t i = top; i < bottom; ++i) bigger->put(i, old->get(i));
+        m_ring.store(bigger, std::memory_order_release);
+        epoch_domain::instance()->retire(old, delete_ring);
+        return bigger;
+    }
+
+public:
+    explicit work_stealing_deque(size_t capacity = 256)
+    {
+        int64_t n = 2;
+        while (n < static_cast<int64_t>(capacity)) n <<= 1;
+        m_ring.store(new ring(n), std::memory_order_relaxed);
+    }
+
+    work_stealing_deque(const work_stealing_deque&) = delete;
+    work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+    ~work_stealing_deque()
+    {
+        delete m_ring.load(std::memory_order_relaxed);
+    }
+
+    // approximate when thieves are active
+    size_t size() const
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // owner only
+    void push(T value)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        ring* r = m_ring.load(std::memory_order_relaxed);
+        if (bottom - top > r->mask) r = grow(r, bottom, top);
+        r->put(bottom, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // owner only
+    std::optional<T> pop()
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        ring* r = m_ring.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        if (top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        T value = r->get(bottom);
+        if (top == bottom)
+        {
+            // last element, race the thieves for it
+            bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            if (!won) return std::nullopt;
+        }
+        return value;
+    }
+
+    // any thread, fails when empty or when it loses a race with another thief or the owner
+    std::optional<T> steal()
+    {
+        epoch_guard guard;
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom) return std::nullopt;
+        ring* r = m_ring.load(std::memory_order_acquire);
+        T value = r->get(top);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return std::nullopt;
+        return value;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,192 @@
+#pragma once
+#include "lock.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// epoch based memory reclamation
+// a thread pins the global epoch while it may hold pointers into a lock-free structure, nodes that were
+// unlinked are retired into the retiring thread's limbo list and freed only once the global epoch has moved
+// two steps past the epoch they were retired in, i.e. once every pinned thread has seen the unlink
+class epoch_domain
+{
+    struct retired
+    {
+        void* ptr;
+        void (*deleter)(void*);
+    };
+
+    struct alignas(cache_line_size) record
+    {
+        // 0 when quiescent, otherwise (pinned epoch << 1) | 1
+        std::atomic<uint64_t> state{0};
+        std::atomic<bool> in_use{false};
+        record* next = nullptr;
+        unsigned nesting = 0;
+        unsigned retired_since_collect = 0;
+        uint64_t limbo_epoch[3] = {0, 0, 0};
+        std::vector<retired> limbo[3];
+
+        void free_limbo(int bucket)
+        {
+            for (auto& r : limbo[bucket]) r.deleter(r.ptr);
+            limbo[bucket].clear();
+        }
+    };
+
+    // records are released when their thread exits, a later thread reuses the record and its pending limbo
+    struct thread_handle
+    {
+        record* rec = nullptr;
+        ~thread_handle()
+        {
+            if (rec)
+            {
+                rec->state.store(0, std::memory_order_release);
+                rec->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    static constexpr unsigned collect_threshold = 64;
+
+    alignas(cache_line_size) std::atomic<uint64_t> m_epoch{1};
+    alignas(cache_line_size) std::atomic<record*> m_records{nullptr};
+
+    epoch_domain() = default;
+
+    record* acquire_record()
+    {
+        for (record* r = m_records.load(std::memory_order_acquire); r; r = r->next)
+        {
+            bool expected = false;
+            if (!r->in_use.load(std::memory_order_relaxed) && r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                return r;
+        }
+        record* r = new record;
+        r->in_use.store(true, std::memory_order_relaxed);
+        r->next = m_records.load(std::memory_order_relaxed);
+        while (!m_records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed));
+        return r;
+    }
+
+    record* local()
+    {
+        thread_local thread_handle handle;
+        if (!handle.rec) handle.rec = acquire_record();
+        return handle.rec;
+    }
+
+    // the epoch only advances when every pinned thread has observed the current one
+    bool try_advance()
+    {
+        uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (record* r = m_records.load(std::memory_order_acquire); r; r = r->next)
+        {
+            uint64_t state = r->state.load(std::memory_order_acquire);
+            if ((state & 1) && (state >> 1) != epoch) return false;
+        }
+        return m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    void collect(record* rec)
+    {
+        uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+        for (int b = 0; b < 3; ++b)
+        {
+            if (!rec->limbo[b].empty() && rec->limbo_epoch[b] + 2 <= epoch)
+                rec->free_limbo(b);
+        }
+    }
+
+public:
+    static epoch_domain* instance()
+    {
+        static epoch_domain domain;
+        return &domain;
+    }
+
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain& operator=(const epoch_domain&) = delete;
+
+    ~epoch_domain()
+    {
+        record* r = m_records.load(std::memory_order_acquire);
+        while (r)
+        {
+            for (int b = 0; b < 3; ++b) r->free_limbo(b);
+            record* next = r->next;
+            delete r;
+            r = next;
+        }
+    }
+
+    // pins are reentrant, only the outermost pin publishes the epoch
+    void pin()
+    {
+        record* rec = local();
+        if (rec->nesting++ == 0)
+        {
+            uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+            rec->state.store((epoch << 1) | 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void unpin()
+    {
+        record* rec = local();
+        if (--rec->nesting == 0)
+            rec->state.store(0, std::memory_order_release);
+    }
+
+    // ptr must already be unreachable for threads that pin after this call
+    void retire(void* ptr, void (*deleter)(void*))
+    {
+        record* rec = local();
+        uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+        int bucket = epoch % 3;
+        if (rec->limbo_epoch[bucket] != epoch)
+        {
+            // whatever is left in this bucket was retired at least three epochs ago
+            rec->free_limbo(bucket);
+            rec->limbo_epoch[bucket] = epoch;
+        }
+        rec->limbo[bucket].push_back({ptr, deleter});
+        if (++rec->retired_since_collect >= collect_threshold)
+        {
+            rec->retired_since_collect = 0;
+            try_advance();
+            collect(rec);
+        }
+    }
+
+    template<typename T>
+    void retire(T* ptr)
+    {
+        retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    // frees what the calling thread has retired as far as the other pinned threads allow
+    void synchronize()
+    {
+        record* rec = local();
+        for (int i = 0; i < 3; ++i) try_advance();
+        collect(rec);
+    }
+
+    uint64_t epoch() const { return m_epoch.load(std::memory_order_relaxed); }
+};
+
+class epoch_guard
+{
+    epoch_domain& m_domain;
+public:
+    epoch_guard(epoch_domain& domain = *epoch_domain::instance()) : m_domain(domain) { m_domain.pin(); }
+    ~epoch_guard() { m_domain.unpin(); }
+
+    epoch_guard(const epoch_guard&) = delete;
+    epoch_guard& operator=(const epoch_guard&) = delete;
+};
@@ -32,6 +32,7 @@ public:
             current_value = std::move(value);
             return {};
         }
+        void return_void() noexcept {}
         void unhandled_exception() noexcept
         {
             exception = std::current_exception();
@@ -1,6 +1,53 @@
 #pragma once
 #include <semaphore>
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <type_traits>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// size used to pad hot atomics onto their own cache line so that producers and consumers do not false share
+inline constexpr std::size_t cache_line_size = 64;
+
+// tells the core we are busy waiting: frees pipeline resources for the sibling hyperthread and saves power
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// one step of a busy wait: pause first, then give the time slice away in case the thread we are waiting for
+// has been preempted (fair locks otherwise stall a whole slice per handoff on oversubscribed hosts)
+class spin_backoff
+{
+    uint32_t m_count = 0;
+public:
+    static constexpr uint32_t spin_limit = 1024;
+    void operator()()
+    {
+        if (m_count < spin_limit)
+        {
+            ++m_count;
+            cpu_relax();
+        }
+        else std::this_thread::yield();
+    }
+};
 
 class spinlock
 {
@@ -15,15 +62,246 @@ public:
         #if defined(__cpp_lib_atomic_flag_test)
             while (m_flag.test(std::memory_order_relaxed))        // test lock
         #endif
-                ; // spin
+                cpu_relax(); // spin
         }
     }
+    bool try_lock()
+    {
+        return !m_flag.test(std::memory_order_relaxed) && !m_flag.test_and_set(std::memory_order_acquire);
+    }
     void unlock()
     {
         m_flag.clear(std::memory_order_release);
     }
 };
 
+// spin with exponential backoff, then yield the time slice, then park on the lock word (futex on linux)
+// the state is 0 when unlocked, 1 when locked and 2 when locked with parked waiters, so unlock
+// only makes a notify call when somebody is actually sleeping
+class adaptive_lock
+{
+public:
+    struct thresholds
+    {
+        uint32_t spin_rounds = 10;      // backoff rounds, each round doubles the pause count
+        uint32_t max_backoff = 1024;    // cap on pauses per round
+        uint32_t yield_rounds = 8;      // sched_yield attempts before parking
+    };
+
+    struct counters
+    {
+        uint64_t spins;
+        uint64_t yields;
+        uint64_t parks;
+    };
+
+private:
+    std::atomic<uint32_t> m_state{0};
+    thresholds m_thresholds;
+    std::atomic<uint64_t> m_spins{0}, m_yields{0}, m_parks{0};
+
+    bool try_acquire()
+    {
+        uint32_t expected = 0;
+        return m_state.load(std::memory_order_relaxed) == 0 &&
+            m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void lock_contended()
+    {
+        uint64_t spins = 0, yields = 0, parks = 0;
+        uint32_t backoff = 1;
+        bool acquired = false;
+        for (uint32_t round = 0; round < m_thresholds.spin_rounds && !acquired; ++round)
+        {
+            for (uint32_t i = 0; i < backoff; ++i) cpu_relax();
+            spins += backoff;
+            backoff = std::min(backoff * 2, m_thresholds.max_backoff);
+            acquired = try_acquire();
+        }
+        for (uint32_t round = 0; round < m_thresholds.yield_rounds && !acquired; ++round)
+        {
+            std::this_thread::yield();
+            ++yields;
+            acquired = try_acquire();
+        }
+        if (!acquired)
+        {
+            // from now on we own the lock with state 2, which makes the next unlock wake a parked waiter
+            while (m_state.exchange(2, std::memory_order_acquire) != 0)
+            {
+                ++parks;
+                m_state.wait(2, std::memory_order_relaxed);
+            }
+        }
+        if (spins) m_spins.fetch_add(spins, std::memory_order_relaxed);
+        if (yields) m_yields.fetch_add(yields, std::memory_order_relaxed);
+        if (parks) m_parks.fetch_add(parks, std::memory_order_relaxed);
+    }
+
+public:
+    adaptive_lock() = default;
+    explicit adaptive_lock(const thresholds& t) : m_thresholds(t) {}
+
+    void lock()
+    {
+        if (!try_acquire()) lock_contended();
+    }
+    bool try_lock()
+    {
+        return try_acquire();
+    }
+    void unlock()
+    {
+        if (m_state.exchange(0, std::memory_order_release) == 2)
+            m_state.notify_one();
+    }
+
+    counters stats() const
+    {
+        return { m_spins.load(std::memory_order_relaxed), m_yields.load(std::memory_order_relaxed), m_parks.load(std::memory_order_relaxed) };
+    }
+};
+
+// fair FIFO lock: waiters take a ticket and spin until it is served, backing off in proportion to their place in line
+class ticket_lock
+{
+    alignas(cache_line_size) std::atomic<uint32_t> m_next{0};
+    alignas(cache_line_size) std::atomic<uint32_t> m_serving{0};
+public:
+    void lock()
+    {
+        const uint32_t ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+        uint32_t spins = 0;
+        while (true)
+        {
+            uint32_t serving = m_serving.load(std::memory_order_acquire);
+            if (serving == ticket) return;
+            // past the pause budget the holder is likely preempted: give it the core, but only one yield per look at
+            // m_serving so that a handoff is still seen right away
+            if (spins >= spin_backoff::spin_limit)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            uint32_t pauses = (ticket - serving) * 8;
+            for (uint32_t i = pauses; i > 0; --i) cpu_relax();
+            spins += pauses;
+        }
+    }
+    bool try_lock()
+    {
+        uint32_t serving = m_serving.load(std::memory_order_relaxed);
+        uint32_t expected = serving;
+        return m_next.compare_exchange_strong(expected, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    void unlock()
+    {
+        m_serving.store(m_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+// fair queue lock (Mellor-Crummey & Scott): waiters form a linked list and each one spins on the flag
+// of its own cache-line sized node, so a release only touches the successor's line
+// nodes come from a per-thread free list, lock and unlock must happen on the same thread like std::mutex
+class mcs_lock
+{
+    struct alignas(cache_line_size) node
+    {
+        std::atomic<node*> next{nullptr};
+        std::atomic<bool> locked{false};
+        node* free_next = nullptr;
+    };
+
+    struct node_cache
+    {
+        node* head = nullptr;
+        ~node_cache()
+        {
+            while (head)
+            {
+                node* n = head;
+                head = head->free_next;
+                delete n;
+            }
+        }
+    };
+
+    static node_cache& cache()
+    {
+        thread_local node_cache c;
+        return c;
+    }
+
+    static node* acquire_node()
+    {
+        node_cache& c = cache();
+        if (!c.head) return new node;
+        node* n = c.head;
+        c.head = n->free_next;
+        return n;
+    }
+
+    static void release_node(node* n)
+    {
+        node_cache& c = cache();
+        n->free_next = c.head;
+        c.head = n;
+    }
+
+    alignas(cache_line_size) std::atomic<node*> m_tail{nullptr};
+    // only read and written by the lock holder
+    node* m_owner = nullptr;
+
+public:
+    void lock()
+    {
+        node* n = acquire_node();
+        n->next.store(nullptr, std::memory_order_relaxed);
+        n->locked.store(true, std::memory_order_relaxed);
+        node* prev = m_tail.exchange(n, std::memory_order_acq_rel);
+        if (prev)
+        {
+            prev->next.store(n, std::memory_order_release);
+            spin_backoff backoff;
+            while (n->locked.load(std::memory_order_acquire)) backoff();
+        }
+        m_owner = n;
+    }
+    bool try_lock()
+    {
+        node* n = acquire_node();
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node* expected = nullptr;
+        if (!m_tail.compare_exchange_strong(expected, n, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            release_node(n);
+            return false;
+        }
+        m_owner = n;
+        return true;
+    }
+    void unlock()
+    {
+        node* n = m_owner;
+        node* next = n->next.load(std::memory_order_acquire);
+        if (!next)
+        {
+            node* expected = n;
+            if (m_tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed))
+            {
+                release_node(n);
+                return;
+            }
+            // a successor swapped itself in but has not linked to us yet
+            spin_backoff backoff;
+            while (!(next = n->next.load(std::memory_order_acquire))) backoff();
+        }
+        next->locked.store(false, std::memory_order_release);
+        release_node(n);
+    }
+};
+
 class rwlock
 {
     template<unsigned int readers_bits, unsigned int wait_to_read_bits, unsigned int writer_bits>
@@ -46,61 +324,67 @@ class rwlock
         static constexpr uint32_t writer_one() { return 1 << (readers_bits + wait_to_read_bits);}
     };
     using status = status_bits<16, 8, 8>;
-    std::atomic<uint32_t> m_status;
+    std::atomic<uint32_t> m_status{0};
     std::counting_semaphore<256> m_readSem{0}, m_writeSem{0};
 
 public:
+    // each update is computed from the snapshot its CAS compares against, a failed CAS refreshes that snapshot.
+    // a saturated counter is waited out rather than written
     void lock_read()
     {
-        status old_status, new_status;
-        do 
+        status old_status = m_status.load(std::memory_order_relaxed), new_status;
+        for (;;)
         {
-            old_status = m_status.load(std::memory_order_relaxed);
-            new_status = m_status.load(std::memory_order_relaxed);
-            if (old_status.writers > 0)
-            {
-                if (!new_status.inc_wait_to_read()) continue;
-            }
-            else
+            new_status = old_status;
+            if (!(old_status.writers > 0 ? new_status.inc_wait_to_read() : new_status.inc_reader()))
             {
-                if (!new_status.inc_reader()) continue;
+                cpu_relax();
+                old_status = m_status.load(std::memory_order_relaxed);
+                continue;
             }
+            if (m_status.compare_exchange_weak(old_status.value, new_status.value, std::memory_order_acquire, std::memory_order_relaxed))
+                break;
         }
-        while (!m_status.compare_exchange_weak(old_status.value, new_status.value, std::memory_order_acquire, std::memory_order_relaxed));
-        
+
         if (new_status.writers > 0)
             m_readSem.acquire();
     }
 
+    // acq_rel: the last reader hands the lock to a waiting writer through m_writeSem, so it has to pass on the
+    // releases of the readers that left before it
     void unlock_read()
     {
-        status old_status = m_status.fetch_sub(status::reader_one(), std::memory_order_release);
+        status old_status = m_status.fetch_sub(status::reader_one(), std::memory_order_acq_rel);
         if (old_status.readers == 1 && old_status.writers > 0)
             m_writeSem.release();
     }
 
     void lock_write()
     {
-        status old_status, new_status;
-        do 
+        status old_status = m_status.load(std::memory_order_relaxed), new_status;
+        for (;;)
         {
-            old_status = m_status.load(std::memory_order_relaxed);
-            new_status = m_status.load(std::memory_order_relaxed);
-            if (!new_status.inc_writer()) continue;
+            new_status = old_status;
+            if (!new_status.inc_writer())
+            {
+                cpu_relax();
+                old_status = m_status.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_status.compare_exchange_weak(old_status.value, new_status.value, std::memory_order_acquire, std::memory_order_relaxed))
+                break;
         }
-        while (!m_status.compare_exchange_weak(old_status.value, new_status.value, std::memory_order_acquire, std::memory_order_relaxed));
-        
-        if (new_status.readers > 0 || new_status.writers > 0)
+
+        if (old_status.readers > 0 || old_status.writers > 0)
             m_writeSem.acquire();
     }
 
     void unlock_write()
     {
-        status old_status, new_status;
-        do 
+        status old_status = m_status.load(std::memory_order_relaxed), new_status;
+        do
         {
-            old_status = m_status.load(std::memory_order_relaxed);
-            new_status = m_status.load(std::memory_order_relaxed);
+            new_status = old_status;
             new_status.writers--;
             if (old_status.wait_to_read > 0)
             {
@@ -119,4 +403,276 @@ public:
             m_writeSem.release();
         }
     }
-};
\ No newline at end of file
+};
+
+// big-reader lock for read-mostly data: every thread counts itself in on its own cache-line padded slot,
+// so readers on different cores never touch the same line, and a writer raises a flag then sweeps all slots
+// until they drain. counters are 64 bit so there is no small limit on readers or waiters
+class distributed_rwlock
+{
+    struct alignas(cache_line_size) reader_slot
+    {
+        std::atomic<uint64_t> readers{0};
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<reader_slot[]> m_slots;
+    alignas(cache_line_size) std::atomic<uint32_t> m_writer{0};
+
+    static size_t thread_index()
+    {
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    reader_slot& slot() { return m_slots[thread_index() & m_mask]; }
+
+    static size_t round_up(size_t n)
+    {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+public:
+    // slots defaults to twice the hardware threads, threads beyond that share slots
+    explicit distributed_rwlock(size_t slots = 0)
+        : m_mask(round_up(slots ? slots : 2 * std::max(1u, std::thread::hardware_concurrency())) - 1),
+        m_slots(new reader_slot[m_mask + 1])
+    {
+    }
+
+    void lock_read()
+    {
+        reader_slot& s = slot();
+        while (true)
+        {
+            // pairs with the writer's flag store then slot load: either we see the writer or it sees us
+            s.readers.fetch_add(1, std::memory_order_seq_cst);
+            if (m_writer.load(std::memory_order_seq_cst) == 0) return;
+            s.readers.fetch_sub(1, std::memory_order_release);
+            m_writer.wait(1, std::memory_order_acquire);
+        }
+    }
+
+    bool try_lock_read()
+    {
+        reader_slot& s = slot();
+        s.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (m_writer.load(std::memory_order_seq_cst) == 0) return true;
+        s.readers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    void unlock_read()
+    {
+        slot().readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock_write()
+    {
+        uint32_t expected = 0;
+        while (!m_writer.compare_exchange_weak(expected, 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            if (expected) m_writer.wait(expected, std::memory_order_relaxed);
+            expected = 0;
+        }
+        for (size_t i = 0; i <= m_mask; ++i)
+        {
+            for (uint32_t spins = 0; m_slots[i].readers.load(std::memory_order_seq_cst) != 0; ++spins)
+            {
+                if (spins < 64) cpu_relax();
+                else std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock_write()
+    {
+        uint32_t expected = 0;
+        if (!m_writer.compare_exchange_strong(expected, 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return false;
+        for (size_t i = 0; i <= m_mask; ++i)
+        {
+            if (m_slots[i].readers.load(std::memory_order_seq_cst) != 0)
+            {
+                unlock_write();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void unlock_write()
+    {
+        m_writer.store(0, std::memory_order_release);
+        m_writer.notify_all();
+    }
+};
+
+// sequence lock around a value that is read far more often than it is written
+// readers copy the value and retry if the sequence was odd (write in progress) or changed meanwhile,
+// so a read never writes shared memory. writers are serialized by a spinlock
+// the value is kept as 64 bit words that are only touched through relaxed atomic_refs: a reader racing with a
+// writer may copy a half written value, which it then throws away, but it never reads memory in a data race.
+// T must be trivially copy constructible/destructible since it is rebuilt from those words
+template<typename T>
+class seqlock
+{
+    static_assert(std::is_trivially_copy_constructible_v<T> && std::is_trivially_destructible_v<T>,
+        "seqlock readers copy the value while it may be written");
+
+    static constexpr size_t word_count = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    struct alignas(std::max(alignof(T), alignof(uint64_t))) words
+    {
+        uint64_t w[word_count] = {};
+    };
+
+    alignas(cache_line_size) std::atomic<uint64_t> m_sequence{0};
+    mutable words m_value;
+    spinlock m_write;
+
+    T read() const
+    {
+        words copy;
+        for (size_t i = 0; i < word_count; ++i)
+            copy.w[i] = std::atomic_ref<uint64_t>(m_value.w[i]).load(std::memory_order_relaxed);
+        // memcpy into byte storage implicitly creates the T
+        alignas(T) unsigned char raw[sizeof(T)];
+        std::memcpy(raw, copy.w, sizeof(T));
+        return *std::launder(reinterpret_cast<T*>(raw));
+    }
+
+    void write(const T& value)
+    {
+        words copy;
+        std::memcpy(copy.w, &value, sizeof(T));
+        for (size_t i = 0; i < word_count; ++i)
+            std::atomic_ref<uint64_t>(m_value.w[i]).store(copy.w[i], std::memory_order_relaxed);
+    }
+
+public:
+    seqlock() : seqlock(T{}) {}
+    explicit seqlock(const T& value) { write(value); }
+
+    T load() const
+    {
+        while (true)
+        {
+            uint64_t before = m_sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                cpu_relax();
+                continue;
+            }
+            T copy = read();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_sequence.load(std::memory_order_relaxed) == before) return copy;
+        }
+    }
+
+    // f mutates a copy of the value, which is published between the two sequence bumps. returns the stored value
+    template<typename F>
+    T update(F&& f)
+    {
+        m_write.lock();
+        T value = read();
+        std::invoke(std::forward<F>(f), value);
+        uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write(value);
+        m_sequence.store(sequence + 2, std::memory_order_release);
+        m_write.unlock();
+        return value;
+    }
+
+    void store(const T& value)
+    {
+        update([&](T& v) { v = value; });
+    }
+
+    uint64_t sequence() const { return m_sequence.load(std::memory_order_acquire); }
+};
+
+// parking spot for threads waiting on a condition that other threads make true without taking a lock, such as a
+// queue becoming non-empty. waiters register before their last check of the condition, so a notify that comes
+// after that check is never lost:
+//   auto key = ec.prepare_wait();
+//   if (condition()) ec.cancel_wait();
+//   else ec.wait(key);
+// and the notifying side makes the condition true, then calls notify(n)
+// the state packs the number of registered waiters (low half) and an epoch (high half) bumped by every notify.
+// sleeping goes through a mutex and condition variable, which gives timed waits; notify skips both while no
+// thread is registered
+class event_count
+{
+    static constexpr uint64_t waiter_one = 1;
+    static constexpr uint64_t epoch_one = uint64_t(1) << 32;
+    static constexpr uint64_t waiter_mask = epoch_one - 1;
+
+    alignas(cache_line_size) std::atomic<uint64_t> m_state{0};
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+public:
+    using key = uint32_t;
+
+    key prepare_wait()
+    {
+        uint64_t state = m_state.fetch_add(waiter_one, std::memory_order_seq_cst);
+        // pairs with the fence in notify: either the waiter's next check sees the new condition or notify sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return static_cast<key>(state >> 32);
+    }
+
+    void cancel_wait()
+    {
+        m_state.fetch_sub(waiter_one, std::memory_order_relaxed);
+    }
+
+    void wait(key k)
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+        m_cv.wait(l, [&]() { return epoch() != k; });
+        m_state.fetch_sub(waiter_one, std::memory_order_relaxed);
+    }
+
+    // false when the deadline passed without a notify
+    template<typename Clock, typename Duration>
+    bool wait_until(key k, const std::chrono::time_point<Clock, Duration>& deadline)
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+        bool notified = m_cv.wait_until(l, deadline, [&]() { return epoch() != k; });
+        m_state.fetch_sub(waiter_one, std::memory_order_relaxed);
+        return notified;
+    }
+
+    template<typename Rep, typename Period>
+    bool wait_for(key k, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        return wait_until(k, std::chrono::steady_clock::now() + timeout);
+    }
+
+    // wakes up to n sleeping waiters, call after making the condition true
+    void notify(size_t n = 1)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t waiters = m_state.load(std::memory_order_relaxed) & waiter_mask;
+        if (waiters == 0 || n == 0) return;
+        // notified under the lock: a woken thread may destroy the event_count as soon as it can take the mutex
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_state.fetch_add(epoch_one, std::memory_order_relaxed);
+        if (n >= waiters) m_cv.notify_all();
+        else while (n--) m_cv.notify_one();
+    }
+
+    void notify_all()
+    {
+        notify(std::numeric_limits<size_t>::max());
+    }
+
+    key epoch() const { return static_cast<key>(m_state.load(std::memory_order_relaxed) >> 32); }
+    size_t waiters() const { return m_state.load(std::memory_order_relaxed) & waiter_mask; }
+};
@@ -0,0 +1,158 @@
+#include "lock.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+template<typename Lock>
+void mutual_exclusion(Lock& mu)
+{
+    const int n_threads = 4, n = 20000;
+    long long counter = 0;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < n_threads; t++)
+        threads.emplace_back([&]()
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mu.lock();
+                counter++;
+                mu.unlock();
+            }
+        });
+    for(auto& t : threads) t.join();
+    ASSERT_EQ(counter, n_threads * n);
+}
+
+TEST(lock, spinlock)
+{
+    spinlock mu;
+    mutual_exclusion(mu);
+}
+
+TEST(lock, adaptive_lock)
+{
+    adaptive_lock mu({.spin_rounds = 2, .max_backoff = 4, .yield_rounds = 1});
+    mutual_exclusion(mu);
+    ASSERT_TRUE(mu.try_lock());
+    ASSERT_FALSE(mu.try_lock());
+    mu.unlock();
+
+    // a waiter behind a long hold goes through every spin and yield round, then parks
+    using namespace std::chrono_literals;
+    adaptive_lock held({.spin_rounds = 2, .max_backoff = 4, .yield_rounds = 1});
+    held.lock();
+    std::atomic<bool> started{false};
+    std::thread waiter([&]() { started = true; held.lock(); held.unlock(); });
+    while (!started) std::this_thread::yield();
+    std::this_thread::sleep_for(50ms);
+    held.unlock();
+    waiter.join();
+    auto stats = held.stats();
+    ASSERT_EQ(stats.spins, 1u + 2u);
+    ASSERT_EQ(stats.yields, 1u);
+    ASSERT_GE(stats.parks, 1u);
+}
+
+TEST(lock, ticket_lock)
+{
+    ticket_lock mu;
+    mutual_exclusion(mu);
+    ASSERT_TRUE(mu.try_lock());
+    ASSERT_FALSE(mu.try_lock());
+    mu.unlock();
+}
+
+TEST(lock, mcs_lock)
+{
+    mcs_lock mu;
+    mutual_exclusion(mu);
+    ASSERT_TRUE(mu.try_lock());
+    ASSERT_FALSE(mu.try_lock());
+    mu.unlock();
+}
+
+template<typename Lock>
+void reader_writer(Lock& mu)
+{
+    long long a = 0, b = 0;
+    std::atomic<bool> torn{false};
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; t++)
+        threads.emplace_back([&]()
+        {
+            for(int i = 0; i < 20000; i++)
+            {
+                mu.lock_read();
+                if (a != b) torn = true;
+                mu.unlock_read();
+            }
+        });
+    threads.emplace_back([&]()
+    {
+        for(int i = 0; i < 2000; i++)
+        {
+            mu.lock_write();
+            a++;
+            b++;
+            mu.unlock_write();
+        }
+    });
+    for(auto& t : threads) t.join();
+    ASSERT_FALSE(torn.load());
+    ASSERT_EQ(a, 2000);
+}
+
+TEST(lock, rwlock)
+{
+    rwlock mu;
+    reader_writer(mu);
+}
+
+TEST(lock, distributed_rwlock)
+{
+    distributed_rwlock mu;
+    reader_writer(mu);
+    ASSERT_TRUE(mu.try_lock_write());
+    ASSERT_FALSE(mu.try_lock_read());
+    mu.unlock_write();
+}
+
+TEST(lock, event_count)
+{
+    event_count ec;
+    auto key = ec.prepare_wait();
+    ASSERT_FALSE(ec.wait_for(key, std::chrono::milliseconds(1)));
+    ASSERT_EQ(ec.waiters(), 0u);
+
+    // a notify between prepare_wait and wait is not lost
+    key = ec.prepare_wait();
+    ec.notify();
+    ec.wait(key);
+
+    std::atomic<int> ready{0};
+    std::atomic<int> woken{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            while (true)
+            {
+                auto k = ec.prepare_wait();
+                if (ready.load() > 0)
+                {
+                    ec.cancel_wait();
+                    break;
+                }
+                ec.wait(k);
+            }
+            woken++;
+        });
+    }
+    ready = 1;
+    ec.notify_all();
+    for (auto& t : threads) t.join();
+    ASSERT_EQ(woken.load(), 3);
+    ASSERT_EQ(ec.waiters(), 0u);
+}
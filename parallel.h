@@ -0,0 +1,244 @@
+#pragma once
+#include "threadpool.h"
+#include "lock.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <vector>
+
+// per-worker accumulator on its own cache line, so workers folding into neighbouring slots do not false share
+template<typename T>
+struct alignas(cache_line_size) padded_partial
+{
+    std::optional<T> value;
+};
+
+// runs f(block) for every block in [0, n_blocks), one block per claim
+template <typename Fun>
+void for_each_block(size_t n_blocks, Fun f)
+{
+    parallel_for_chunks(n_blocks, [&](size_t b, size_t e)
+    {
+        for (size_t block = b; block < e; ++block) f(block);
+    }, 1);
+}
+
+// reduce_op must be associative and commutative, as for std::reduce: chunks are claimed dynamically and every worker
+// folds whatever chunks it gets into its own partial, the partials are combined with init at the end
+template <std::random_access_iterator Iterator, typename T, typename ReduceOp, typename Transform>
+T parallel_transform_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op, Transform transform, size_t grain = 0)
+{
+    std::vector<padded_partial<T>> partials(threadpool::instance()->size() + 1);
+    parallel_for_chunks(static_cast<size_t>(last - first), [&](size_t slot, size_t b, size_t e)
+    {
+        auto& partial = partials[slot].value;
+        auto it = first + b;
+        if (!partial) partial.emplace(std::invoke(transform, *it++));
+        for (auto end = first + e; it != end; ++it)
+            *partial = std::invoke(reduce_op, std::move(*partial), std::invoke(transform, *it));
+    }, grain);
+    for (auto& partial : partials)
+        if (partial.value) init = std::invoke(reduce_op, std::move(init), std::move(*partial.value));
+    return init;
+}
+
+template <std::ranges::random_access_range R, typename T, typename ReduceOp, typename Transform>
+T parallel_transform_reduce(R&& r, T init, ReduceOp reduce_op, Transform transform, size_t grain = 0)
+{
+    return parallel_transform_reduce(std::ranges::begin(r), std::ranges::end(r), std::move(init), std::move(reduce_op), std::move(transform), grain);
+}
+
+template <std::random_access_iterator Iterator, typename T, typename ReduceOp = std::plus<>>
+T parallel_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op = {}, size_t grain = 0)
+{
+    return parallel_transform_reduce(first, last, std::move(init), std::move(reduce_op), std::identity{}, grain);
+}
+
+template <std::ranges::random_access_range R, typename T, typename ReduceOp = std::plus<>>
+T parallel_reduce(R&& r, T init, ReduceOp reduce_op = {}, size_t grain = 0)
+{
+    return parallel_reduce(std::ranges::begin(r), std::ranges::end(r), std::move(init), std::move(reduce_op), grain);
+}
+
+// two-pass blocked scan: the input is cut into one block per worker, pass one reduces every block, the block sums are
+// scanned serially into block offsets, pass two rescans every block starting from its offset and writes the output
+// op must be associative. the output may alias the input
+template <std::random_access_iterator InputIt, std::random_access_iterator OutputIt, typename Op, typename T>
+OutputIt parallel_scan_blocked(InputIt first, InputIt last, OutputIt out, Op op, std::optional<T> init, bool inclusive)
+{
+    size_t n = static_cast<size_t>(last - first);
+    if (n == 0) return out;
+    size_t n_blocks = std::min(n, threadpool::instance()->size() + 1);
+    auto block_begin = [&](size_t block) { return n * block / n_blocks; };
+
+    std::vector<padded_partial<T>> sums(n_blocks);
+    for_each_block(n_blocks - 1, [&](size_t block)
+    {
+        auto it = first + block_begin(block), end = first + block_begin(block + 1);
+        T sum = *it++;
+        for (; it != end; ++it) sum = std::invoke(op, std::move(sum), *it);
+        sums[block].value.emplace(std::move(sum));
+    });
+
+    std::vector<std::optional<T>> offsets(n_blocks);
+    offsets[0] = std::move(init);
+    for (size_t block = 1; block < n_blocks; ++block)
+        offsets[block] = offsets[block - 1] ? std::invoke(op, *offsets[block - 1], *sums[block - 1].value) : *sums[block - 1].value;
+
+    for_each_block(n_blocks, [&](size_t block)
+    {
+        std::optional<T> acc = std::move(offsets[block]);
+        auto dst = out + block_begin(block);
+        for (auto it = first + block_begin(block), end = first + block_begin(block + 1); it != end; ++it, ++dst)
+        {
+            T value = *it;
+            if (!inclusive) *dst = *acc;
+            acc = acc ? std::invoke(op, std::move(*acc), std::move(value)) : std::move(value);
+            if (inclusive) *dst = *acc;
+        }
+    });
+    return out + n;
+}
+
+template <std::random_access_iterator InputIt, std::random_access_iterator OutputIt, typename Op = std::plus<>>
+OutputIt parallel_inclusive_scan(InputIt first, InputIt last, OutputIt out, Op op = {})
+{
+    return parallel_scan_blocked(first, last, out, std::move(op), std::optional<std::iter_value_t<InputIt>>{}, true);
+}
+
+template <std::random_access_iterator InputIt, std::random_access_iterator OutputIt, typename T, typename Op = std::plus<>>
+OutputIt parallel_exclusive_scan(InputIt first, InputIt last, OutputIt out, T init, Op op = {})
+{
+    return parallel_scan_blocked(first, last, out, std::move(op), std::optional<T>(std::move(init)), false);
+}
+
+// how many of the first d outputs of a stable merge of a and b come from a (merge path split)
+template <typename Iterator, typename Compare>
+size_t merge_path_split(Iterator a, size_t n_a, Iterator b, size_t n_b, size_t d, Compare& comp)
+{
+    size_t lo = d > n_b ? d - n_b : 0, hi = std::min(d, n_a);
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (!comp(b[d - mid - 1], a[mid])) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// stable parallel merge sort: one block per worker is sorted with std::stable_sort, then runs are merged pairwise
+// between the input and a buffer. every merge is cut along the merge path into pieces, so the last rounds, which
+// have fewer merges than workers, still use the whole pool
+template <std::random_access_iterator Iterator, typename Compare = std::ranges::less>
+void parallel_sort(Iterator first, Iterator last, Compare comp = {})
+{
+    using value_type = std::iter_value_t<Iterator>;
+    static constexpr size_t serial_cutoff = 4096;
+    size_t n = static_cast<size_t>(last - first);
+    size_t n_workers = threadpool::instance()->size() + 1;
+    if (n <= serial_cutoff || n_workers == 1)
+    {
+        std::stable_sort(first, last, std::ref(comp));
+        return;
+    }
+
+    std::vector<size_t> runs;
+    size_t n_blocks = std::min(n_workers, n / serial_cutoff);
+    for (size_t block = 0; block <= n_blocks; ++block) runs.push_back(n * block / n_blocks);
+    for_each_block(n_blocks, [&](size_t block)
+    {
+        std::stable_sort(first + runs[block], first + runs[block + 1], std::ref(comp));
+    });
+    if (n_blocks == 1) return;
+
+    std::vector<value_type> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+    bool in_buffer = true;
+    while (runs.size() > 2)
+    {
+        size_t n_pairs = runs.size() / 2;
+        size_t pieces = (n_workers + n_pairs - 1) / n_pairs;
+        auto merge_pieces = [&](auto src, auto dst)
+        {
+            for_each_block(n_pairs * pieces, [&](size_t job)
+            {
+                size_t pair = job / pieces, piece = job % pieces;
+                size_t begin = runs[2 * pair], middle = runs[std::min(2 * pair + 1, runs.size() - 1)];
+                size_t end = runs[std::min(2 * pair + 2, runs.size() - 1)];
+                size_t n_a = middle - begin, n_b = end - middle, total = n_a + n_b;
+                size_t d0 = total * piece / pieces, d1 = total * (piece + 1) / pieces;
+                size_t i0 = merge_path_split(src + begin, n_a, src + middle, n_b, d0, comp);
+                size_t i1 = merge_path_split(src + begin, n_a, src + middle, n_b, d1, comp);
+                std::merge(std::make_move_iterator(src + begin + i0), std::make_move_iterator(src + begin + i1),
+                           std::make_move_iterator(src + middle + (d0 - i0)), std::make_move_iterator(src + middle + (d1 - i1)),
+                           dst + begin + d0, std::ref(comp));
+            });
+        };
+        if (in_buffer) merge_pieces(buffer.begin(), first);
+        else merge_pieces(first, buffer.begin());
+        in_buffer = !in_buffer;
+
+        std::vector<size_t> merged;
+        for (size_t i = 0; i < runs.size(); i += 2) merged.push_back(runs[i]);
+        if (merged.back() != n) merged.push_back(n);
+        runs = std::move(merged);
+    }
+    if (in_buffer)
+        parallel_for_chunks(n, [&](size_t b, size_t e) { std::move(buffer.begin() + b, buffer.begin() + e, first + b); });
+}
+
+template <std::ranges::random_access_range R, typename Compare = std::ranges::less>
+void parallel_sort(R&& r, Compare comp = {})
+{
+    parallel_sort(std::ranges::begin(r), std::ranges::end(r), std::move(comp));
+}
+
+// lowest-index element satisfying pred. the index of the best match so far is shared by every task: chunks starting
+// past it are not scanned, running chunks stop at the next element past it, and a task stops claiming once the
+// chunks it gets start past it
+template <std::random_access_iterator Iterator, typename Pred>
+Iterator parallel_find_if(Iterator first, Iterator last, Pred pred, size_t grain = 0)
+{
+    size_t n = static_cast<size_t>(last - first);
+    std::atomic<size_t> found{n};
+    parallel_for_chunks_until(n, [&](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e && i < found.load(std::memory_order_relaxed); ++i)
+        {
+            if (std::invoke(pred, first[i]))
+            {
+                size_t current = found.load(std::memory_order_relaxed);
+                while (i < current && !found.compare_exchange_weak(current, i, std::memory_order_relaxed));
+                return false;
+            }
+        }
+        return b < found.load(std::memory_order_relaxed);
+    }, grain);
+    return first + found.load(std::memory_order_relaxed);
+}
+
+template <std::ranges::random_access_range R, typename Pred>
+std::ranges::borrowed_iterator_t<R> parallel_find_if(R&& r, Pred pred, size_t grain = 0)
+{
+    return parallel_find_if(std::ranges::begin(r), std::ranges::end(r), std::move(pred), grain);
+}
+
+template <std::ranges::random_access_range R, typename Pred>
+bool parallel_any_of(R&& r, Pred pred, size_t grain = 0)
+{
+    return parallel_find_if(r, std::move(pred), grain) != std::ranges::end(r);
+}
+
+template <std::ranges::random_access_range R, typename Pred>
+bool parallel_all_of(R&& r, Pred pred, size_t grain = 0)
+{
+    return parallel_find_if(r, std::not_fn(std::move(pred)), grain) == std::ranges::end(r);
+}
+
+template <std::ranges::random_access_range R, typename Pred>
+bool parallel_none_of(R&& r, Pred pred, size_t grain = 0)
+{
+    return !parallel_any_of(r, std::move(pred), grain);
+}
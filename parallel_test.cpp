@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "parallel.h"
+
+#include <numeric>
+#include <random>
+#include <string>
+
+TEST(parallel, reduce)
+{
+    std::vector<long long> v(100000);
+    std::iota(v.begin(), v.end(), 0);
+    ASSERT_EQ(parallel_reduce(v, 0LL), 100000LL * 99999 / 2);
+    ASSERT_EQ(parallel_reduce(v.begin(), v.end(), 7LL, [](long long a, long long b) { return std::max(a, b); }), 99999);
+    ASSERT_EQ(parallel_transform_reduce(v, 0LL, std::plus<>{}, [](long long x) { return x % 2; }), 50000);
+
+    std::vector<int> empty;
+    ASSERT_EQ(parallel_reduce(empty, 42), 42);
+}
+
+TEST(parallel, scan)
+{
+    std::vector<int> v(10007);
+    std::iota(v.begin(), v.end(), 1);
+    std::vector<int> expected(v.size()), out(v.size());
+
+    std::inclusive_scan(v.begin(), v.end(), expected.begin());
+    parallel_inclusive_scan(v.begin(), v.end(), out.begin());
+    ASSERT_EQ(out, expected);
+
+    std::exclusive_scan(v.begin(), v.end(), expected.begin(), 5);
+    parallel_exclusive_scan(v.begin(), v.end(), v.begin(), 5);
+    ASSERT_EQ(v, expected);
+
+    // non-commutative op, only associativity is allowed
+    std::vector<std::string> s{"a", "b", "c", "d", "e"};
+    std::vector<std::string> concat(s.size());
+    parallel_inclusive_scan(s.begin(), s.end(), concat.begin());
+    ASSERT_EQ(concat.back(), "abcde");
+    ASSERT_EQ(concat[2], "abc");
+}
+
+TEST(parallel, sort)
+{
+    std::mt19937 rng(42);
+    for (size_t n : {0, 1, 100, 4097, 100000})
+    {
+        std::vector<int> v(n);
+        for (auto& x : v) x = static_cast<int>(rng() % 1000);
+        auto expected = v;
+        std::sort(expected.begin(), expected.end());
+        parallel_sort(v);
+        ASSERT_EQ(v, expected);
+    }
+
+    // stability: equal keys keep their input order
+    std::vector<std::pair<int, int>> pairs(50000);
+    for (int i = 0; i < static_cast<int>(pairs.size()); ++i) pairs[i] = {static_cast<int>(rng() % 16), i};
+    parallel_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    ASSERT_TRUE(std::is_sorted(pairs.begin(), pairs.end()));
+}
+
+TEST(parallel, find)
+{
+    std::vector<int> v(1000000, 0);
+    v[123456] = 1;
+    v[900000] = 1;
+    v[999999] = 1;
+    std::atomic<size_t> visited{0};
+    auto it = parallel_find_if(v, [&](int x) { visited++; return x == 1; });
+    ASSERT_EQ(it - v.begin(), 123456);
+    ASSERT_LT(visited.load(), v.size());
+
+    // the lowest index wins even when a later chunk matches first
+    ASSERT_EQ(parallel_find_if(v.begin(), v.end(), [](int x) { return x == 1; }, 1000) - v.begin(), 123456);
+    ASSERT_EQ(parallel_find_if(v, [](int x) { return x == 2; }), v.end());
+
+    ASSERT_TRUE(parallel_any_of(v, [](int x) { return x == 1; }));
+    ASSERT_FALSE(parallel_all_of(v, [](int x) { return x == 0; }));
+    ASSERT_TRUE(parallel_all_of(v, [](int x) { return x < 2; }));
+    ASSERT_TRUE(parallel_none_of(v, [](int x) { return x < 0; }));
+}
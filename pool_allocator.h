@@ -0,0 +1,143 @@
+#pragma once
+#include "lock.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+// system allocations made on the task submission path: block_pool misses, ring_buffer and work_stealing_deque
+// growth, small_function heap fallback. after warm-up submitting a task that fits inline should leave this
+// unchanged, which is what the allocation-free tests check
+inline std::atomic<size_t> task_path_allocations{0};
+
+// recycles fixed size blocks instead of returning them to the allocator
+// every thread keeps a small free list and only touches the shared list, under a spinlock, to move a batch of
+// blocks in or out. blocks are never given back to the system, so after warm-up allocation is a pointer pop
+template<size_t BlockSize>
+class block_pool
+{
+    struct block
+    {
+        block* next;
+    };
+
+    static constexpr size_t cache_limit = 256;
+    static constexpr size_t batch_size = 64;
+
+    struct thread_cache
+    {
+        block* head = nullptr;
+        size_t count = 0;
+
+        ~thread_cache()
+        {
+            if (head) block_pool::instance().give_back(head, count);
+        }
+    };
+
+    spinlock m_lock;
+    block* m_shared = nullptr;
+
+    static thread_cache& cache()
+    {
+        thread_local thread_cache c;
+        return c;
+    }
+
+    void give_back(block* head, size_t count)
+    {
+        block* tail = head;
+        for (size_t i = 1; i < count; ++i) tail = tail->next;
+        m_lock.lock();
+        tail->next = m_shared;
+        m_shared = head;
+        m_lock.unlock();
+    }
+
+    void refill(thread_cache& c)
+    {
+        m_lock.lock();
+        while (m_shared && c.count < batch_size)
+        {
+            block* b = m_shared;
+            m_shared = b->next;
+            b->next = c.head;
+            c.head = b;
+            ++c.count;
+        }
+        m_lock.unlock();
+    }
+
+public:
+    static constexpr size_t block_size = BlockSize < sizeof(block) ? sizeof(block) : BlockSize;
+
+    // never destroyed: worker threads return their caches while static objects are being torn down
+    static block_pool& instance()
+    {
+        static block_pool* pool = new block_pool;
+        return *pool;
+    }
+
+    void* allocate()
+    {
+        thread_cache& c = cache();
+        if (!c.head) refill(c);
+        if (!c.head)
+        {
+            task_path_allocations.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(block_size);
+        }
+        block* b = c.head;
+        c.head = b->next;
+        --c.count;
+        return b;
+    }
+
+    void deallocate(void* p)
+    {
+        thread_cache& c = cache();
+        block* b = static_cast<block*>(p);
+        b->next = c.head;
+        c.head = b;
+        if (++c.count > cache_limit)
+        {
+            // hand the older half to the shared list, where threads that mostly allocate can pick it up
+            block* keep = c.head;
+            for (size_t i = 1; i < cache_limit / 2; ++i) keep = keep->next;
+            block* spill = keep->next;
+            keep->next = nullptr;
+            give_back(spill, c.count - cache_limit / 2);
+            c.count = cache_limit / 2;
+        }
+    }
+};
+
+// std allocator over block_pool for single objects, arrays and over-aligned types go to operator new
+template<typename T>
+struct recycling_allocator
+{
+    using value_type = T;
+
+    recycling_allocator() noexcept = default;
+    template<typename U>
+    recycling_allocator(const recycling_allocator<U>&) noexcept {}
+
+    static constexpr size_t rounded_size = (sizeof(T) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    static constexpr bool pooled = alignof(T) <= alignof(std::max_align_t);
+
+    T* allocate(size_t n)
+    {
+        if (pooled && n == 1) return static_cast<T*>(block_pool<rounded_size>::instance().allocate());
+        task_path_allocations.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (pooled && n == 1) block_pool<rounded_size>::instance().deallocate(p);
+        else ::operator delete(p, std::align_val_t(alignof(T)));
+    }
+
+    template<typename U>
+    bool operator==(const recycling_allocator<U>&) const noexcept { return true; }
+};
@@ -47,4 +47,226 @@ TEST(concurrent_queue, test1)
             s.insert(val);
     }
     ASSERT_EQ(1,1);
-}
\ No newline at end of file
+}
+
+TEST(mpmc_queue, bounded)
+{
+    mpmc_queue<int> q(4);
+    ASSERT_EQ(q.capacity(), 4);
+    for(int i = 0; i < 4; i++) ASSERT_TRUE(q.try_push(i));
+    ASSERT_FALSE(q.try_push(4));
+    for(int i = 0; i < 4; i++) ASSERT_EQ(q.pop().value(), i);
+    ASSERT_FALSE(q.pop());
+}
+
+TEST(mpmc_queue, producers_consumers)
+{
+    mpmc_queue<int> q(64);
+    const int n = 10000;
+    std::atomic<long long> sum{0};
+    std::atomic<int> popped{0};
+    std::vector<std::thread> threads;
+    for(int p = 0; p < 4; p++)
+        threads.emplace_back([&]() { for(int i = 1; i <= n; i++) q.push(i); });
+    for(int c = 0; c < 4; c++)
+        threads.emplace_back([&]()
+        {
+            while (popped.load() < 4 * n)
+            {
+                auto val = q.pop();
+                if (val)
+                {
+                    sum += val.value();
+                    popped++;
+                }
+                else std::this_thread::yield();
+            }
+        });
+    for(auto& t : threads) t.join();
+    ASSERT_EQ(sum.load(), 4LL * n * (n + 1) / 2);
+    ASSERT_TRUE(q.empty());
+}
+
+TEST(spsc_queue, batch)
+{
+    spsc_queue<int> q(8);
+    std::vector<int> in = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    auto rest = q.write_batch(in.begin(), in.end());
+    ASSERT_EQ(rest - in.begin(), 8);
+    ASSERT_FALSE(q.try_push(11));
+    std::vector<int> out;
+    ASSERT_EQ(q.read_batch(std::back_inserter(out), 3), 3);
+    ASSERT_EQ(q.write_batch(rest, in.end()), in.end());
+    while (auto val = q.try_pop()) out.push_back(val.value());
+    ASSERT_EQ(out, in);
+}
+
+TEST(spsc_queue, producer_consumer)
+{
+    spsc_queue<std::string> q(16);
+    const int n = 10000;
+    std::thread producer([&]()
+    {
+        for(int i = 0; i < n; i++)
+            while (!q.try_push(std::to_string(i))) std::this_thread::yield();
+    });
+    for(int i = 0; i < n;)
+    {
+        if (auto val = q.try_pop())
+            ASSERT_EQ(val.value(), std::to_string(i++));
+        else
+            std::this_thread::yield();
+    }
+    producer.join();
+}
+
+TEST(concurrent_queue, bulk)
+{
+    concurrent_queue<std::unique_ptr<int>> q;
+    std::vector<std::unique_ptr<int>> in;
+    for(int i = 0; i < 10; i++) in.push_back(std::make_unique<int>(i));
+    size_t notified = 0;
+    q.push_bulk_and_notify(std::move(in), [&](size_t n) { notified = n; });
+    ASSERT_EQ(notified, 10);
+    std::vector<std::unique_ptr<int>> out;
+    ASSERT_EQ(q.pop_bulk(std::back_inserter(out), 4), 4);
+    ASSERT_EQ(*out[3], 3);
+    auto rest = q.drain();
+    ASSERT_EQ(rest.size(), 6);
+    ASSERT_EQ(*rest.front(), 4);
+    ASSERT_TRUE(q.empty());
+}
+
+TEST(segmented_queue, producers_consumers)
+{
+    segmented_queue<int, 4> q;
+    const int n = 10000;
+    std::atomic<long long> sum{0};
+    std::atomic<int> popped{0};
+    std::vector<std::thread> threads;
+    for(int p = 0; p < 4; p++)
+        threads.emplace_back([&]() { for(int i = 1; i <= n; i++) q.push(i); });
+    for(int c = 0; c < 4; c++)
+        threads.emplace_back([&]()
+        {
+            while (popped.load() < 4 * n)
+            {
+                auto val = q.pop();
+                if (val)
+                {
+                    sum += val.value();
+                    popped++;
+                }
+                else std::this_thread::yield();
+            }
+        });
+    for(auto& t : threads) t.join();
+    ASSERT_EQ(sum.load(), 4LL * n * (n + 1) / 2);
+    ASSERT_TRUE(q.empty());
+}
+
+TEST(epoch_domain, retire)
+{
+    static std::atomic<int> destroyed{0};
+    struct node { ~node() { destroyed++; } };
+    auto domain = epoch_domain::instance();
+    int before = destroyed.load();
+    {
+        epoch_guard guard;
+        domain->retire(new node);
+        domain->synchronize();
+        // still pinned, the node may be in use
+        ASSERT_EQ(destroyed.load(), before);
+    }
+    domain->synchronize();
+    ASSERT_EQ(destroyed.load(), before + 1);
+}
+
+TEST(concurrent_priority_queue, exact)
+{
+    concurrent_priority_queue<prioritized<std::string>, std::greater<>> q(priority_ordering::exact);
+    q.push({3, "c"});
+    q.push({1, "a"});
+    q.push({2, "b"});
+    ASSERT_EQ(q.pop().value().value, "a");
+    ASSERT_EQ(q.pop().value().value, "b");
+    ASSERT_EQ(q.pop().value().value, "c");
+    ASSERT_FALSE(q.pop());
+}
+
+TEST(concurrent_priority_queue, relaxed)
+{
+    concurrent_priority_queue<int> q;
+    const int n = 1000;
+    std::vector<std::thread> threads;
+    for(int p = 0; p < 4; p++)
+        threads.emplace_back([&]() { for(int i = 0; i < n; i++) q.push(i); });
+    for(auto& t : threads) t.join();
+    ASSERT_EQ(q.size(), 4 * n);
+    // the first pops come from the tops of the heaps
+    ASSERT_GE(q.pop().value(), n / 2);
+    std::set<int> seen;
+    while (auto val = q.pop()) seen.insert(val.value());
+    ASSERT_EQ(seen.size(), n);
+    ASSERT_TRUE(q.empty());
+}
+
+TEST(concurrent_queue, lock_type)
+{
+    concurrent_queue<int, std::deque<int>, adaptive_lock> q;
+    q.push(1);
+    q.emplace(2);
+    ASSERT_EQ(q.pop().value(), 1);
+    ASSERT_EQ(q.size(), 1);
+}
+
+TEST(concurrent_queue, fair_locks)
+{
+    concurrent_queue<int, std::deque<int>, ticket_lock> q1;
+    concurrent_queue<int, std::deque<int>, mcs_lock> q2;
+    q1.push(1);
+    q2.push(2);
+    ASSERT_EQ(q1.pop().value(), 1);
+    ASSERT_EQ(q2.pop().value(), 2);
+}
+
+TEST(work_stealing_deque, owner_and_thieves)
+{
+    work_stealing_deque<int> d(4);
+    const int n = 20000;
+    std::atomic<long long> sum{0};
+    std::atomic<int> taken{0};
+    std::vector<std::thread> thieves;
+    for(int t = 0; t < 3; t++)
+        thieves.emplace_back([&]()
+        {
+            while (taken.load() < n)
+            {
+                if (auto val = d.steal())
+                {
+                    sum += val.value();
+                    taken++;
+                }
+                else std::this_thread::yield();
+            }
+        });
+    for(int i = 1; i <= n; i++)
+    {
+        d.push(i);
+        if (i % 3 == 0)
+        {
+            if (auto val = d.pop())
+            {
+                sum += val.value();
+                taken++;
+            }
+        }
+    }
+    while (auto val = d.pop())
+    {
+        sum += val.value();
+        taken++;
+    }
+    for(auto& t : thieves) t.join();
+    ASSERT_EQ(sum.load(), 1LL * n * (n + 1) / 2);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "pool_allocator.h"
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature, size_t Capacity = 56>
+class small_function;
+
+// move-only std::function replacement: callables up to Capacity bytes live inline, so wrapping a typical lambda
+// never allocates. larger callables fall back to the heap. with the default capacity the whole object is one cache line
+template<typename R, typename... Args, size_t Capacity>
+class small_function<R(Args...), Capacity>
+{
+    struct vtable
+    {
+        R (*invoke)(void*, Args&&...);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template<typename F>
+    static constexpr bool fits_inline = sizeof(F) <= Capacity && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+    template<typename F>
+    static constexpr vtable inline_vtable =
+    {
+        [](void* p, Args&&... args) -> R { return std::invoke(*static_cast<F*>(p), std::forward<Args>(args)...); },
+        [](void* dst, void* src) noexcept { new (dst) F(std::move(*static_cast<F*>(src))); static_cast<F*>(src)->~F(); },
+        [](void* p) noexcept { static_cast<F*>(p)->~F(); }
+    };
+
+    template<typename F>
+    static constexpr vtable heap_vtable =
+    {
+        [](void* p, Args&&... args) -> R { return std::invoke(**static_cast<F**>(p), std::forward<Args>(args)...); },
+        [](void* dst, void* src) noexcept { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+        [](void* p) noexcept { delete *static_cast<F**>(p); }
+    };
+
+    alignas(std::max_align_t) unsigned char m_storage[Capacity];
+    const vtable* m_vtable = nullptr;
+
+    void reset() noexcept
+    {
+        if (m_vtable) m_vtable->destroy(m_storage);
+        m_vtable = nullptr;
+    }
+
+public:
+    small_function() noexcept = default;
+    small_function(std::nullptr_t) noexcept {}
+
+    template<typename F>
+        requires (!std::is_same_v<std::decay_t<F>, small_function> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+    small_function(F&& f)
+    {
+        using functor = std::decay_t<F>;
+        if constexpr (fits_inline<functor>)
+        {
+            new (m_storage) functor(std::forward<F>(f));
+            m_vtable = &inline_vtable<functor>;
+        }
+        else
+        {
+            task_path_allocations.fetch_add(1, std::memory_order_relaxed);
+            *reinterpret_cast<functor**>(m_storage) = new functor(std::forward<F>(f));
+            m_vtable = &heap_vtable<functor>;
+        }
+    }
+
+    small_function(small_function&& other) noexcept : m_vtable(other.m_vtable)
+    {
+        if (m_vtable) m_vtable->move(m_storage, other.m_storage);
+        other.m_vtable = nullptr;
+    }
+
+    small_function& operator=(small_function&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            m_vtable = other.m_vtable;
+            if (m_vtable) m_vtable->move(m_storage, other.m_storage);
+            other.m_vtable = nullptr;
+        }
+        return *this;
+    }
+
+    small_function(const small_function&) = delete;
+    small_function& operator=(const small_function&) = delete;
+
+    ~small_function() { reset(); }
+
+    explicit operator bool() const noexcept { return m_vtable != nullptr; }
+
+    R operator()(Args... args)
+    {
+        return m_vtable->invoke(m_storage, std::forward<Args>(args)...);
+    }
+};
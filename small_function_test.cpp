@@ -0,0 +1,23 @@
+#include "small_function.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <array>
+
+TEST(small_function, inline_and_heap)
+{
+    auto p = std::make_unique<int>(41);
+    small_function<int(int)> f = [p = std::move(p)](int i) { return *p + i; };
+    ASSERT_EQ(f(1), 42);
+    small_function<int(int)> g = std::move(f);
+    ASSERT_FALSE(f);
+    ASSERT_EQ(g(2), 43);
+
+    std::array<int, 64> big{};
+    big[63] = 7;
+    small_function<int()> h = [big]() { return big[63]; };
+    small_function<int()> k;
+    k = std::move(h);
+    ASSERT_EQ(k(), 7);
+    ASSERT_EQ(sizeof(small_function<void()>), 64);
+}
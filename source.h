@@ -3,45 +3,85 @@
 #include "observable.h"
 #include "task.h"
 #include "generator.h"
+#include "lock.h"
 
-template <typename... Args>
-class source : public observable<Args...>
+// how a source keeps its value
+// plain: a tuple read and written by the owning thread, get returns references into it
+// snapshot: the tuple lives behind a seqlock, get/snapshot copy a consistent tuple from any thread without writing
+//           shared memory while one writer sets it. the element types must be trivially copy constructible
+// either way observers are notified on the writer's thread with the value it just stored
+enum class source_mode
+{
+    plain,
+    snapshot
+};
+
+template <source_mode Mode, typename... Args>
+class basic_source : public observable<Args...>
 {
-    std::tuple<Args...> __value;
+    using value_type = std::tuple<Args...>;
+    static constexpr bool snapshots = Mode == source_mode::snapshot;
+
+    std::conditional_t<snapshots, seqlock<value_type>, value_type> __value;
 public:
-    explicit source(const std::tuple<Args...> &v) : __value(v) {}
-    explicit source(const Args &...v) : __value(v...) {}
+    explicit basic_source(const value_type &v) : __value(v) {}
+    explicit basic_source(const Args &...v) : __value(value_type(v...)) {}
 
-    source(source&& other) : __value(std::move(other.__value)) {}
-    source& operator=(source&& other) { __value = std::move(other.__value);}
+    basic_source(basic_source&& other) requires (!snapshots) : __value(std::move(other.__value)) {}
+    basic_source& operator=(basic_source&& other) requires (!snapshots) { __value = std::move(other.__value); return *this; }
 
     template <size_t Index>
-    void set(const std::remove_reference<decltype(std::get<Index>(__value))>::type &v)
+    void set(const std::tuple_element_t<Index, value_type> &v)
     {
-        std::get<Index>(__value) = v;
-        this->notify_change(__value, std::index_sequence_for<Args...>{});
+        store<Index>(v);
     }
 
     template <size_t Index>
-    void set(std::remove_reference<decltype(std::get<Index>(__value))>::type &&v)
+    void set(std::tuple_element_t<Index, value_type> &&v)
     {
-        std::get<Index>(__value) = v;
-        this->notify_change(__value, std::index_sequence_for<Args...>{});
+        store<Index>(std::move(v));
     }
 
-    void operator=(const std::remove_reference<decltype(std::get<0>(__value))>::type &v) requires (std::tuple_size_v<std::tuple<Args...>> == 1)
+    void operator=(const std::tuple_element_t<0, value_type> &v) requires (sizeof...(Args) == 1)
     {
-        std::get<0>(__value) = v;
-        this->notify_change(__value, std::index_sequence_for<Args...>{});
+        store<0>(v);
     }
 
+    // plain: a reference to the element, snapshot: a copy of it
     template <size_t Index>
-    decltype(std::get<Index>(__value)) get() { return std::get<Index>(__value); }
+    decltype(auto) get()
+    {
+        if constexpr (snapshots) return std::tuple_element_t<Index, value_type>(std::get<Index>(__value.load()));
+        else return std::get<Index>(__value);
+    }
+
+    value_type snapshot() const requires snapshots { return __value.load(); }
 
 private:
+    template <size_t Index, typename V>
+    void store(V &&v)
+    {
+        if constexpr (snapshots)
+        {
+            value_type updated = __value.update([&](value_type &t) { std::get<Index>(t) = std::forward<V>(v); });
+            this->notify_change(updated, std::index_sequence_for<Args...>{});
+        }
+        else
+        {
+            std::get<Index>(__value) = std::forward<V>(v);
+            this->notify_change(__value, std::index_sequence_for<Args...>{});
+        }
+    }
+
     template <typename Tuple, size_t... Is>
     void notify_change(const Tuple &t, std::index_sequence<Is...>)
     {
         this->notify(std::get<Is>(t)...);
     }
-};
\ No newline at end of file
+};
+
+template <typename... Args>
+using source = basic_source<source_mode::plain, Args...>;
+
+template <typename... Args>
+using snapshot_source = basic_source<source_mode::snapshot, Args...>;
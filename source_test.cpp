@@ -17,4 +17,30 @@ TEST(source, test2)
     s.subscribe([](const int& i, const float& j) { std::cout << i << " " << j << std::endl;});
     s.set<0>(2);
     s.set<1>(0.2);
-}
\ No newline at end of file
+}
+
+TEST(source, snapshot)
+{
+    snapshot_source<int, int> s(0, 0);
+    int notified = 0;
+    s.subscribe([&](const int&, const int&) { notified++; });
+    std::atomic<bool> done{false}, torn{false};
+    std::thread reader([&]()
+    {
+        while (!done)
+        {
+            auto [i, j] = s.snapshot();
+            if (i != j && i != j + 1) torn = true;
+        }
+    });
+    for(int i = 1; i <= 1000; i++)
+    {
+        s.set<0>(i);
+        s.set<1>(i);
+    }
+    done = true;
+    reader.join();
+    ASSERT_FALSE(torn.load());
+    ASSERT_EQ(s.get<0>(), 1000);
+    ASSERT_EQ(notified, 2000);
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include "threadpool.h"
+#include "small_function.h"
+#include "pool_allocator.h"
+#include "lock.h"
+
+#include <atomic>
+#include <utility>
+
+// serial executor on a threadpool: handlers posted to a strand run one at a time, in the order they were posted,
+// on whichever worker picks the strand up. state touched only from one strand's handlers needs no lock
+//   strand s;
+//   s.post([&]{ connection.on_data(...); });
+// handlers go through an intrusive MPSC queue (Vyukov): a post is one exchange on the tail plus one store, nothing
+// is locked. a count of queued handlers decides who schedules the strand: the post that takes it from 0 enqueues
+// a drain task, the drain runs handlers until the count drops back to 0, so a strand never holds more than one
+// worker. an idle strand is two cache lines and owns no task or thread, thousands of them cost nothing
+// handlers must not throw (as with threadpool::enqueue)
+class strand
+{
+    struct link
+    {
+        std::atomic<link*> next{nullptr};
+    };
+
+    struct handler : link
+    {
+        small_function<void()> f;
+
+        explicit handler(small_function<void()>&& f) : f(std::move(f)) {}
+    };
+
+    // handlers run per drain task, then the strand goes to the back of its lane queue (not the worker's own deque,
+    // which would hand it straight back) so that a busy strand does not keep a worker from everything else
+    static constexpr size_t batch = 64;
+
+    // producers
+    alignas(cache_line_size) std::atomic<link*> m_tail;
+    std::atomic<size_t> m_pending{0};
+    threadpool* m_pool;
+    task_lane m_lane;
+    // consumer, only touched by the drain task
+    alignas(cache_line_size) link* m_head;
+    link m_stub;
+
+    static strand*& current()
+    {
+        thread_local strand* running = nullptr;
+        return running;
+    }
+
+    void push(link* n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        link* prev = m_tail.exchange(n, std::memory_order_acq_rel);
+        // between the exchange and this store the queue is briefly cut, try_pop() sees an empty queue meanwhile
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    handler* try_pop()
+    {
+        link* head = m_head;
+        link* next = head->next.load(std::memory_order_acquire);
+        if (head == &m_stub)
+        {
+            if (!next) return nullptr;
+            m_head = next;
+            head = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next)
+        {
+            m_head = next;
+            return static_cast<handler*>(head);
+        }
+        if (head != m_tail.load(std::memory_order_acquire)) return nullptr;
+        // head is the last handler, put the stub behind it so that head can be taken
+        push(&m_stub);
+        next = head->next.load(std::memory_order_acquire);
+        if (!next) return nullptr;
+        m_head = next;
+        return static_cast<handler*>(head);
+    }
+
+    // a counted handler is at most one interrupted push away
+    handler* pop()
+    {
+        spin_backoff backoff;
+        handler* h;
+        while (!(h = try_pop())) backoff();
+        return h;
+    }
+
+    void drain()
+    {
+        strand* outer = std::exchange(current(), this);
+        for (size_t i = 0; i < batch; ++i)
+        {
+            handler* h = pop();
+            h->f();
+            h->~handler();
+            recycling_allocator<handler>{}.deallocate(h, 1);
+            // the strand may be gone once its last handler is counted, only locals are touched from here on
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                current() = outer;
+                return;
+            }
+        }
+        current() = outer;
+        m_pool->enqueue_back([this]() { drain(); }, m_lane);
+    }
+
+public:
+    explicit strand(threadpool* pool = threadpool::instance(), task_lane lane = task_lane::normal)
+        : m_tail(&m_stub), m_pool(pool), m_lane(lane), m_head(&m_stub)
+    {
+    }
+
+    strand(const strand&) = delete;
+    strand& operator=(const strand&) = delete;
+
+    // waits for the queued handlers to run, helping the pool when called from one of its workers. must not be
+    // called from a handler of this strand
+    ~strand()
+    {
+        auto drained = [this]() { return m_pending.load(std::memory_order_acquire) == 0; };
+        if (m_pool->help_until(drained)) return;
+        spin_backoff backoff;
+        while (!drained()) backoff();
+    }
+
+    // f runs after every handler posted before it, never concurrently with another handler of this strand
+    template<typename F>
+    void post(F&& f)
+    {
+        handler* h = new (recycling_allocator<handler>{}.allocate(1)) handler(small_function<void()>(std::forward<F>(f)));
+        push(h);
+        if (m_pending.fetch_add(1, std::memory_order_acq_rel) == 0) m_pool->enqueue([this]() { drain(); }, m_lane);
+    }
+
+    // true inside a handler of this strand
+    bool running_in_this_thread() const { return current() == this; }
+
+    threadpool* pool() const { return m_pool; }
+};
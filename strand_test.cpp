@@ -0,0 +1,83 @@
+#include "strand.h"
+
+#include <gtest/gtest.h>
+#include <latch>
+#include <memory>
+#include <vector>
+
+TEST(strand, serial)
+{
+    // plain ints touched only from the strand's handlers, posted from several threads at once
+    threadpool pool({.threads = 4, .name = "strand"});
+    strand s(&pool);
+    constexpr int producers = 4;
+    constexpr int per_producer = 20000;
+    int count = 0;
+    int running = 0;
+    int overlaps = 0;
+    std::vector<int> last(producers, -1);
+    int out_of_order = 0;
+    std::latch done(producers * per_producer);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&, p]()
+        {
+            for (int i = 0; i < per_producer; ++i)
+            {
+                s.post([&, p, i]()
+                {
+                    if (running++) ++overlaps;
+                    if (!s.running_in_this_thread()) ++overlaps;
+                    if (last[p] != i - 1) ++out_of_order;
+                    last[p] = i;
+                    ++count;
+                    --running;
+                    done.count_down();
+                });
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    done.wait();
+    ASSERT_EQ(count, producers * per_producer);
+    ASSERT_EQ(overlaps, 0);
+    ASSERT_EQ(out_of_order, 0);
+    ASSERT_FALSE(s.running_in_this_thread());
+}
+
+TEST(strand, many_strands)
+{
+    threadpool pool({.threads = 4, .name = "strands"});
+    constexpr int n_strands = 10000;
+    constexpr int per_strand = 10;
+    std::vector<std::unique_ptr<strand>> strands;
+    std::vector<int> counts(n_strands);
+    for (int i = 0; i < n_strands; ++i) strands.push_back(std::make_unique<strand>(&pool));
+    std::latch done(n_strands * per_strand);
+    for (int round = 0; round < per_strand; ++round)
+        for (int i = 0; i < n_strands; ++i)
+            strands[i]->post([&, i]() { ++counts[i]; done.count_down(); });
+    done.wait();
+    for (int c : counts) ASSERT_EQ(c, per_strand);
+}
+
+TEST(strand, yields_between_batches)
+{
+    // one worker, held until a long strand and a plain task are both queued: the task must not wait for the whole strand
+    threadpool pool({.threads = 1, .name = "strand"});
+    strand s(&pool);
+    constexpr int handlers = 200;
+    std::latch hold(1);
+    pool.enqueue([&]() { hold.wait(); });
+    int ran = 0;
+    int ran_before_task = -1;
+    std::latch done(handlers + 1);
+    for (int i = 0; i < handlers; ++i) s.post([&]() { ++ran; done.count_down(); });
+    pool.enqueue([&]() { ran_before_task = ran; done.count_down(); });
+    hold.count_down();
+    done.wait();
+    ASSERT_EQ(ran, handlers);
+    ASSERT_GT(ran_before_task, 0);
+    ASSERT_LT(ran_before_task, handlers);
+}
@@ -2,10 +2,13 @@
 
 #include "generator.h" 
 #include "task.h"
+#include "concurrent_queue.h"
 
 #include <random>
 #include <string>
 #include <fstream>
+#include <iterator>
+#include <vector>
 
 template <std::movable T>
 struct stream_base
@@ -190,40 +193,65 @@ struct async_stream : public stream_base<T>
 
 class text_file_stream : public async_stream<std::string>
 {
-    std::thread t;
+    static constexpr size_t batch_size = 64;
+
+    // lines travel from the reader thread to the consumer through an spsc ring, published a batch at a time
+    spsc_queue<std::string> m_lines{1024};
     std::atomic<bool> isStopped;
+    std::atomic<bool> m_eof{false};
+    std::thread t;
 public:
     text_file_stream(const char* filename) 
         : isStopped(false),
         t(std::move(std::thread([=,this]()
         {
-            // std::cout << "go in thread" << std::endl;
             std::ifstream fs(filename, std::ios::in);
             if (fs.is_open())
             {
-                // std::cout << "file is open" << std::endl;
+                std::vector<std::string> batch;
+                batch.reserve(batch_size);
+                std::string line;
                 while (!isStopped)
                 {
-                    // using namespace std::literals;
-                    // std::this_thread::sleep_for(200ms);
-                    std::string line; 
-                    if (std::getline(fs, line))
-                    {
-                        // std::cout << "line :" << line << std::endl;
-                        value.set(std::move(line));
-                    }
-                    else break;
+                    batch.clear();
+                    while (batch.size() < batch_size && std::getline(fs, line))
+                        batch.push_back(std::move(line));
+                    auto first = std::make_move_iterator(batch.begin()), last = std::make_move_iterator(batch.end());
+                    while (!isStopped && (first = m_lines.write_batch(first, last)) != last)
+                        std::this_thread::yield();
+                    if (batch.size() < batch_size) break;
                 }
-                isStopped = true;
             }
             else
             {
                 std::cout << "file not found !" << std::endl;
             }
+            m_eof.store(true, std::memory_order_release);
         })))
     {}
 
     void start() override { isStopped = false; }
     void stop() override { isStopped = true; if (t.joinable()) t.join(); } 
     bool is_stopped() override { return isStopped; }
+
+    // ends when the whole file has been consumed
+    generator<std::string> get() override
+    {
+        std::vector<std::string> batch;
+        batch.reserve(batch_size);
+        while (true)
+        {
+            if (is_stopped())
+                throw "stream is stopped ?";
+            batch.clear();
+            if (m_lines.read_batch(std::back_inserter(batch), batch_size) == 0)
+            {
+                if (m_eof.load(std::memory_order_acquire) && m_lines.empty()) co_return;
+                std::this_thread::yield();
+                continue;
+            }
+            for (auto& line : batch)
+                co_yield std::move(line);
+        }
+    }
 };
\ No newline at end of file
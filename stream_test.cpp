@@ -1,6 +1,10 @@
 #include "stream.h"
 
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
 
 TEST(stream, test1)
 {
@@ -58,4 +62,32 @@ TEST(stream, test3)
         std::cerr << e.what() << '\n';
     }
     fs.stop();
-}
\ No newline at end of file
+}
+// writes n numbered lines to a temporary file and reads them back through the stream
+static std::vector<std::string> round_trip(size_t n)
+{
+    auto path = std::filesystem::temp_directory_path() / ("text_file_stream_" + std::to_string(n) + ".txt");
+    {
+        std::ofstream out(path);
+        for (size_t i = 0; i < n; ++i) out << "line " << i << '\n';
+    }
+    std::vector<std::string> lines;
+    std::string name = path.string();
+    text_file_stream fs(name.c_str());
+    fs.start();
+    for (auto&& line : fs.get()) lines.push_back(line);
+    fs.stop();
+    std::filesystem::remove(path);
+    return lines;
+}
+
+TEST(stream, text_file_batches)
+{
+    // empty, one partial batch, an exact multiple of the 64 line batch, and more than the 1024 line ring holds
+    for (size_t n : {0, 10, 64 * 3, 5000})
+    {
+        auto lines = round_trip(n);
+        ASSERT_EQ(lines.size(), n);
+        for (size_t i = 0; i < n; ++i) ASSERT_EQ(lines[i], "line " + std::to_string(i));
+    }
+}
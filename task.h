@@ -1,82 +1,87 @@
 #pragma once
 #include "threadpool.h"
-#include <future>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
 #include <type_traits>
 #include <coroutine>
 #include <concepts>
+#include <variant>
 
-template <std::movable T>
-struct future
+// result of a job launched by task(), shared by the job and the future that awaits it. the job stores its result
+// and then resumes the awaiting coroutine, if one got there first, on the thread that ran the job: nothing blocks
+// while a job is awaited
+template <typename T>
+class task_state
 {
-    struct promise_type
+    using storage = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    // the awaiting coroutine's address, or this state once the result is in
+    std::atomic<void*> m_continuation{nullptr};
+    std::optional<storage> m_value;
+    std::exception_ptr m_exception;
+
+public:
+    template <typename F>
+    void run(F&& f) noexcept
     {
-        std::future<T> value;
-        future get_return_object()
+        try
         {
-            return {std::coroutine_handle<promise_type>::from_promise(*this)};
-        }
-        std::suspend_always initial_suspend() noexcept
-        {
-            // std::cout << "initial" << std::endl;
-            return {};
-        }
-        std::suspend_always final_suspend() noexcept
-        {
-            // std::cout << "final" << std::endl;
-            return {};
+            if constexpr (std::is_void_v<T>)
+            {
+                std::invoke(std::forward<F>(f));
+                m_value.emplace();
+            }
+            else m_value.emplace(std::invoke(std::forward<F>(f)));
         }
-        void return_value(std::future<T> x)
+        catch (...)
         {
-            std::cout << "return value" << std::endl;
-            value = std::move(x);
+            m_exception = std::current_exception();
         }
-        void unhandled_exception() noexcept {}
+        void* continuation = m_continuation.exchange(this, std::memory_order_acq_rel);
+        if (continuation) std::coroutine_handle<>::from_address(continuation).resume();
+    }
 
-        ~promise_type()
-        {
-            // std::cout << "future ~promise_type" << std::endl;
-        }
-    };
+    bool ready() const noexcept { return m_continuation.load(std::memory_order_acquire) == this; }
 
-    struct awaitable
+    // false when the result came in meanwhile, the caller goes on without suspending
+    bool set_continuation(std::coroutine_handle<> h) noexcept
     {
-        future &m_future;
-        bool await_ready() const noexcept { return false; }
-
-        void await_suspend(std::coroutine_handle<> handle)
-        {
-            std::cout << "await_suspend" << std::endl;
-            m_future.coro.resume();
-            handle.resume();
-        }
+        void* expected = nullptr;
+        return m_continuation.compare_exchange_strong(expected, h.address(), std::memory_order_acq_rel);
+    }
 
-        T await_resume()
-        {
-            std::cout << "await_resume" << std::endl;
-            return m_future.coro.promise().value.get();
-        }
+    T take()
+    {
+        if (m_exception) std::rethrow_exception(m_exception);
+        if constexpr (!std::is_void_v<T>) return std::move(*m_value);
+    }
+};
 
-        ~awaitable()
-        {
-            std::cout << "~AwaitableFuture" << std::endl;
-        }
-    };
+// awaitable result of task(), awaited at most once
+template <typename T>
+    requires std::is_void_v<T> || std::movable<T>
+struct future
+{
+    std::shared_ptr<task_state<T>> state;
 
-    std::coroutine_handle<promise_type> coro;
+    struct awaitable
+    {
+        task_state<T>& m_state;
 
-    future(std::coroutine_handle<promise_type> coro) : coro{coro} {}
+        bool await_ready() const noexcept { return m_state.ready(); }
+        bool await_suspend(std::coroutine_handle<> handle) noexcept { return m_state.set_continuation(handle); }
+        T await_resume() { return m_state.take(); }
+    };
 
-    ~future()
-    {
-        // std::cout << "~future" << std::endl;
-        if (coro)
-            coro.destroy();
-    }
+    bool ready() const noexcept { return state->ready(); }
 
     awaitable operator co_await()
     {
-        // std::cout << "co_await" << std::endl;
-        return {*this};
+        return {*state};
     }
 };
 
@@ -86,20 +91,34 @@ enum class launch_policy
     threadpool
 };
 
+// f and args are moved into the job, the state comes from a recycling pool.
+// standard runs the job on a new detached thread, threadpool on the default pool
 template <typename F, typename... Args>
-future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> task(F &&f, Args &&...args)
+future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> task(launch_policy policy, task_lane lane, F &&f, Args &&...args)
 {
-    co_return threadpool::instance()->schedule(f, args...);
+    using return_type = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+    auto state = std::allocate_shared<task_state<return_type>>(recycling_allocator<task_state<return_type>>{});
+    auto job = [state, f = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable
+    {
+        state->run([&]() -> return_type { return std::invoke(std::move(f), std::move(args)...); });
+    };
+    if (policy == launch_policy::standard)
+        std::thread(std::move(job)).detach();
+    else
+        threadpool::instance()->enqueue(std::move(job), lane);
+    return {std::move(state)};
 }
 
 template <typename F, typename... Args>
 future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> task(launch_policy policy, F &&f, Args &&...args)
 {
-    if (policy == launch_policy::standard)
-        co_return std::async(std::launch::async, f, args...);
+    return task(policy, task_lane::normal, std::forward<F>(f), std::forward<Args>(args)...);
+}
 
-    else if (policy == launch_policy::threadpool)
-        co_return threadpool::instance()->schedule(f, args...);
+template <typename F, typename... Args>
+future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> task(F &&f, Args &&...args)
+{
+    return task(launch_policy::threadpool, task_lane::normal, std::forward<F>(f), std::forward<Args>(args)...);
 }
 
 template <typename T>
@@ -107,7 +126,9 @@ struct async
 {
     struct promise_type
     {
-        std::coroutine_handle<> precursor;
+        // the awaiting coroutine's address, or this promise once the coroutine has finished: the coroutine may
+        // finish on another thread while it is being awaited
+        std::atomic<void*> precursor{nullptr};
         T value;
         std::exception_ptr exception = nullptr;
 
@@ -124,18 +145,18 @@ struct async
                 void await_resume() noexcept {}
                 std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
                 {
-                    auto precursor = h.promise().precursor;
+                    void* precursor = h.promise().precursor.exchange(&h.promise(), std::memory_order_acq_rel);
                     if (precursor)
-                        return precursor;
+                        return std::coroutine_handle<>::from_address(precursor);
                     else
                         return std::noop_coroutine();
                 }
             };
             return awaiter{};
         }
-        void return_value(T value)
+        void return_value(T result)
         {
-            value = std::move(value);
+            value = std::move(result);
         }
         void unhandled_exception() noexcept
         {
@@ -151,15 +172,17 @@ struct async
 
     std::coroutine_handle<promise_type> handle;
 
-    bool await_ready() noexcept { return handle.done(); }
+    bool await_ready() noexcept { return false; }
     T await_resume() noexcept
     {
         handle.promise().rethrow_unhandled_exception();
         return handle.promise().value;
     }
-    void await_suspend(std::coroutine_handle<> h) noexcept
+    // does not suspend when the coroutine has already finished
+    bool await_suspend(std::coroutine_handle<> h) noexcept
     {
-        handle.promise().precursor = h;
+        void* expected = nullptr;
+        return handle.promise().precursor.compare_exchange_strong(expected, h.address(), std::memory_order_acq_rel);
     }
 
     ~async() {}
@@ -170,7 +193,9 @@ struct async<void>
 {
     struct promise_type
     {
-        std::coroutine_handle<> precursor;
+        // the awaiting coroutine's address, or this promise once the coroutine has finished: the coroutine may
+        // finish on another thread while it is being awaited
+        std::atomic<void*> precursor{nullptr};
         std::exception_ptr exception = nullptr;
 
         async get_return_object()
@@ -186,9 +211,9 @@ struct async<void>
                 void await_resume() noexcept {}
                 std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
                 {
-                    auto precursor = h.promise().precursor;
+                    void* precursor = h.promise().precursor.exchange(&h.promise(), std::memory_order_acq_rel);
                     if (precursor)
-                        return precursor;
+                        return std::coroutine_handle<>::from_address(precursor);
                     else
                         return std::noop_coroutine();
                 }
@@ -210,19 +235,47 @@ struct async<void>
 
     std::coroutine_handle<promise_type> handle;
 
-    bool await_ready() noexcept { return handle.done(); }
+    bool await_ready() noexcept { return false; }
     void await_resume() noexcept
     {
         handle.promise().rethrow_unhandled_exception();
     }
-    void await_suspend(std::coroutine_handle<> h) noexcept
+    // does not suspend when the coroutine has already finished
+    bool await_suspend(std::coroutine_handle<> h) noexcept
     {
-        handle.promise().precursor = h;
+        void* expected = nullptr;
+        return handle.promise().precursor.compare_exchange_strong(expected, h.address(), std::memory_order_acq_rel);
     }
 
     ~async() {}
 };
 
+// co_await sleep_for(d) suspends the coroutine without holding a thread, the timer re-posts it to the pool
+struct sleep_awaitable
+{
+    timer_wheel::clock::time_point deadline;
+    threadpool* pool;
+    task_lane lane;
+
+    bool await_ready() const noexcept { return deadline <= timer_wheel::clock::now(); }
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        pool->schedule_at(deadline, [h]() { h.resume(); }, lane);
+    }
+    void await_resume() noexcept {}
+};
+
+inline sleep_awaitable sleep_until(timer_wheel::clock::time_point deadline, threadpool* pool = threadpool::instance(), task_lane lane = task_lane::normal)
+{
+    return {deadline, pool, lane};
+}
+
+template <typename Rep, typename Period>
+sleep_awaitable sleep_for(std::chrono::duration<Rep, Period> delay, threadpool* pool = threadpool::instance(), task_lane lane = task_lane::normal)
+{
+    return {timer_wheel::clock::now() + std::chrono::duration_cast<timer_wheel::clock::duration>(delay), pool, lane};
+}
+
 /// \brief
 /// A manual-reset event that supports only a single awaiting
 /// coroutine at a time.
@@ -0,0 +1,159 @@
+#pragma once
+#include "threadpool.h"
+#include "small_function.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <stdexcept>
+#include <vector>
+
+// dag of tasks declared up front and run as many times as needed
+//   task_graph g;
+//   auto load = g.add([]{ ... });
+//   auto parse = g.add([]{ ... });
+//   g.precede(load, parse);
+//   g.run();   // blocks until every node has run, rethrows the first exception of a node
+// every node keeps an atomic count of unfinished predecessors. the worker finishing the last predecessor of a node
+// runs it directly, while its inputs are still in that worker's cache; further ready successors go to the pool.
+// running an unchanged graph again allocates nothing, nodes are not allowed to modify the graph
+class task_graph
+{
+public:
+    using node_id = size_t;
+
+private:
+    struct node
+    {
+        small_function<void()> work;
+        std::vector<node_id> successors;
+        size_t n_predecessors = 0;
+        std::atomic<size_t> pending{0};
+    };
+
+    threadpool* m_pool;
+    std::vector<std::unique_ptr<node>> m_nodes;
+    std::vector<node_id> m_roots;
+    bool m_validated = false;
+
+    std::atomic<size_t> m_remaining{0};
+    std::atomic<bool> m_failed{false};
+    std::exception_ptr m_exception;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    bool m_running = false;
+
+    // kahn's algorithm over the predecessor counts, so that a cycle is reported instead of hanging run()
+    void validate()
+    {
+        m_roots.clear();
+        std::vector<size_t> pending(m_nodes.size());
+        std::vector<node_id> ready;
+        for (node_id id = 0; id < m_nodes.size(); ++id)
+        {
+            pending[id] = m_nodes[id]->n_predecessors;
+            if (!pending[id]) ready.push_back(id);
+        }
+        m_roots = ready;
+        size_t visited = 0;
+        while (!ready.empty())
+        {
+            node_id id = ready.back();
+            ready.pop_back();
+            ++visited;
+            for (node_id s : m_nodes[id]->successors)
+                if (--pending[s] == 0) ready.push_back(s);
+        }
+        if (visited != m_nodes.size()) throw std::logic_error("task_graph has a cycle");
+        m_validated = true;
+    }
+
+    void execute(node_id id)
+    {
+        while (true)
+        {
+            node& n = *m_nodes[id];
+            try
+            {
+                n.work();
+            }
+            catch (...)
+            {
+                if (!m_failed.exchange(true)) m_exception = std::current_exception();
+            }
+
+            // keep the first ready successor for this thread, hand the others to the pool
+            bool inline_next = false;
+            for (node_id s : n.successors)
+            {
+                if (m_nodes[s]->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+                if (!inline_next) id = s;
+                else m_pool->enqueue([this, s]() { execute(s); });
+                inline_next = true;
+            }
+            // the graph may be gone once the last node is counted, only locals are touched from here on
+            finish_one();
+            if (!inline_next) return;
+        }
+    }
+
+    void finish_one()
+    {
+        if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        // notify under the lock: run() may return and destroy the graph as soon as it sees m_running cleared
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_running = false;
+        m_done.notify_all();
+    }
+
+public:
+    explicit task_graph(threadpool* pool = threadpool::instance()) : m_pool(pool) {}
+
+    task_graph(const task_graph&) = delete;
+    task_graph& operator=(const task_graph&) = delete;
+
+    template<typename F>
+    node_id add(F&& f)
+    {
+        m_nodes.push_back(std::make_unique<node>());
+        m_nodes.back()->work = small_function<void()>(std::forward<F>(f));
+        m_validated = false;
+        return m_nodes.size() - 1;
+    }
+
+    // `to` runs after `from` has finished
+    void precede(node_id from, node_id to)
+    {
+        m_nodes.at(from)->successors.push_back(to);
+        m_nodes.at(to)->n_predecessors++;
+        m_validated = false;
+    }
+
+    size_t size() const { return m_nodes.size(); }
+
+    // must not be called from a node of this graph, or concurrently with itself. called from a task of the pool, the
+    // worker runs other tasks while it waits
+    void run()
+    {
+        if (!m_validated) validate();
+        if (m_nodes.empty()) return;
+        for (auto& n : m_nodes) n->pending.store(n->n_predecessors, std::memory_order_relaxed);
+        m_failed.store(false, std::memory_order_relaxed);
+        m_exception = nullptr;
+        m_running = true;
+        m_remaining.store(m_nodes.size(), std::memory_order_release);
+        m_pool->enqueue_bulk(m_roots | std::views::transform([this](node_id id)
+        {
+            return [this, id]() { execute(id); };
+        }));
+
+        // from a worker of the pool, keep running tasks (possibly this graph's nodes) until the last node is counted
+        m_pool->help_until([this]() { return m_remaining.load(std::memory_order_acquire) == 0; });
+        std::unique_lock<std::mutex> l(m_mutex);
+        m_done.wait(l, [this]() { return !m_running; });
+        if (m_exception) std::rethrow_exception(m_exception);
+    }
+};
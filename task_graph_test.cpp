@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "task_graph.h"
+
+#include <mutex>
+
+TEST(task_graph, dependencies)
+{
+    // diamond of layers: every node of a layer depends on every node of the previous one
+    static const int LAYERS = 8, WIDTH = 4;
+    task_graph g;
+    std::atomic<int> finished_layer[LAYERS] = {};
+    std::atomic<bool> ordered{true};
+    std::vector<task_graph::node_id> previous;
+    for (int layer = 0; layer < LAYERS; ++layer)
+    {
+        std::vector<task_graph::node_id> current;
+        for (int i = 0; i < WIDTH; ++i)
+        {
+            auto id = g.add([&, layer]()
+            {
+                if (layer > 0 && finished_layer[layer - 1].load() % WIDTH != 0) ordered = false;
+                finished_layer[layer]++;
+            });
+            for (auto p : previous) g.precede(p, id);
+            current.push_back(id);
+        }
+        previous = current;
+    }
+    ASSERT_EQ(g.size(), static_cast<size_t>(LAYERS * WIDTH));
+
+    for (int run = 1; run <= 50; ++run)
+    {
+        g.run();
+        for (int layer = 0; layer < LAYERS; ++layer) ASSERT_EQ(finished_layer[layer].load(), run * WIDTH);
+    }
+    ASSERT_TRUE(ordered.load());
+}
+
+TEST(task_graph, errors)
+{
+    task_graph g;
+    auto a = g.add([]() { throw std::runtime_error("stage failed"); });
+    std::atomic<int> ran{0};
+    auto b = g.add([&]() { ran++; });
+    g.precede(a, b);
+    ASSERT_THROW(g.run(), std::runtime_error);
+    ASSERT_EQ(ran.load(), 1);
+
+    g.precede(b, a);
+    ASSERT_THROW(g.run(), std::logic_error);
+}
+
+TEST(task_graph, run_from_task)
+{
+    // the only worker runs the graph's nodes while it waits for them
+    threadpool single({.threads = 1});
+    task_graph g(&single);
+    std::atomic<int> nodes{0};
+    auto a = g.add([&]() { nodes++; });
+    auto b = g.add([&]() { nodes++; });
+    g.precede(a, b);
+    single.schedule([&]() { g.run(); g.run(); }).get();
+    ASSERT_EQ(nodes.load(), 4);
+}
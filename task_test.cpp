@@ -1,6 +1,16 @@
 #include "task.h"
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <latch>
+#include <stdexcept>
+
+static bool wait_for(auto done)
+{
+    using namespace std::literals;
+    for (int i = 0; i < 2000 && !done(); ++i) std::this_thread::sleep_for(1ms);
+    return done();
+}
 
 async<int> fn1()
 {
@@ -23,14 +33,56 @@ async<int> fn2()
     co_return result;
 }
 
-async<int> test()
+async<void> test(std::atomic<int>& result)
 {
     auto v1 = fn1();
     auto v2 = fn2();
-    co_return (co_await v1) + (co_await v2);
+    result = (co_await v1) + (co_await v2);
 }
 
 TEST(task, test1)
 {
-    test();
-}
\ No newline at end of file
+    std::atomic<int> result{0};
+    test(result);
+    ASSERT_TRUE(wait_for([&]() { return result.load() == 3; }));
+}
+
+async<void> high_lane(std::atomic<int>& result)
+{
+    result = co_await task(launch_policy::threadpool, task_lane::high, [](int x) { return x + 1; }, 41);
+}
+
+TEST(task, lane)
+{
+    std::atomic<int> result{0};
+    high_lane(result);
+    ASSERT_TRUE(wait_for([&]() { return result.load() == 42; }));
+}
+
+async<void> chain(std::latch& release, std::atomic<int>& result)
+{
+    int sum = 0;
+    for (int i = 0; i < 8; ++i)
+        sum += co_await task([&release, i]() { release.wait(); return i; });
+    co_await task(launch_policy::standard, []() {});
+    try
+    {
+        co_await task([]() -> int { throw std::runtime_error("job"); });
+    }
+    catch (const std::runtime_error&)
+    {
+        sum += 100;
+    }
+    result = sum;
+}
+
+TEST(task, awaiting_does_not_block)
+{
+    // the awaiting coroutines hold no thread: a hundred of them wait on the pool's jobs, the caller carries on
+    std::latch release(1);
+    constexpr int n = 100;
+    std::atomic<int> results[n] = {};
+    for (auto& result : results) chain(release, result);
+    release.count_down();
+    for (auto& result : results) ASSERT_TRUE(wait_for([&]() { return result.load() == 28 + 100; }));
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include "lock.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// threadpool instrumentation is compiled in with -DTHREADPOOL_TELEMETRY (cmake -DTHREADPOOL_TELEMETRY=ON), it must
+// be the same for every translation unit. when off, the pool records nothing and snapshots only hold queue depths
+#if defined(THREADPOOL_TELEMETRY)
+inline constexpr bool telemetry_enabled = true;
+#else
+inline constexpr bool telemetry_enabled = false;
+#endif
+
+using telemetry_clock = std::chrono::steady_clock;
+
+// log-linear histogram of nanosecond latencies in the spirit of HdrHistogram: values below 2^sub_bits are exact,
+// above that every power of two is split into 2^sub_bits buckets, so a recorded value is off by at most 1/16.
+// one writer per histogram (its worker), relaxed counters, readers may see a slightly torn but consistent-enough view
+class latency_histogram
+{
+public:
+    static constexpr unsigned sub_bits = 4;
+    static constexpr unsigned sub_count = 1u << sub_bits;
+    static constexpr unsigned max_exponent = 48; // ~3 days in nanoseconds
+    static constexpr size_t bucket_count = (max_exponent - sub_bits + 2) * sub_count;
+
+    static size_t bucket_of(uint64_t ns)
+    {
+        if (ns < sub_count) return static_cast<size_t>(ns);
+        unsigned exponent = std::min<unsigned>(std::bit_width(ns) - 1, max_exponent);
+        uint64_t sub = (ns >> (exponent - sub_bits)) & (sub_count - 1);
+        return (exponent - sub_bits + 1) * sub_count + static_cast<size_t>(sub);
+    }
+
+    // highest value that falls into the bucket
+    static uint64_t bucket_value(size_t bucket)
+    {
+        if (bucket < sub_count) return bucket;
+        unsigned exponent = static_cast<unsigned>(bucket / sub_count) + sub_bits - 1;
+        uint64_t sub = bucket % sub_count;
+        return ((sub_count + sub + 1) << (exponent - sub_bits)) - 1;
+    }
+
+    void record(uint64_t ns)
+    {
+        auto& bucket = m_buckets[bucket_of(ns)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sum.store(m_sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns > m_max.load(std::memory_order_relaxed)) m_max.store(ns, std::memory_order_relaxed);
+    }
+
+    void record(telemetry_clock::duration d)
+    {
+        record(static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count())));
+    }
+
+    // plain copy for reporting, several of them can be merged
+    struct snapshot
+    {
+        std::vector<uint64_t> buckets = std::vector<uint64_t>(bucket_count);
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+
+        void merge(const snapshot& other)
+        {
+            for (size_t i = 0; i < bucket_count; ++i) buckets[i] += other.buckets[i];
+            count += other.count;
+            sum += other.sum;
+            max = std::max(max, other.max);
+        }
+
+        // p in [0, 1], upper bound of the bucket holding the p-th value
+        uint64_t percentile(double p) const
+        {
+            if (count == 0) return 0;
+            uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * count + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucket_count; ++i)
+            {
+                seen += buckets[i];
+                if (seen >= rank) return std::min(bucket_value(i), max);
+            }
+            return max;
+        }
+
+        uint64_t mean() const { return count ? sum / count : 0; }
+    };
+
+    snapshot read() const
+    {
+        snapshot s;
+        for (size_t i = 0; i < bucket_count; ++i) s.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        s.count = m_count.load(std::memory_order_relaxed);
+        s.sum = m_sum.load(std::memory_order_relaxed);
+        s.max = m_max.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// counters owned by one worker, on their own cache lines so that recording never bounces a line between workers
+struct alignas(cache_line_size) worker_telemetry
+{
+    std::atomic<uint64_t> tasks{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> parks{0};
+    std::atomic<uint64_t> busy_ns{0};
+    std::atomic<uint64_t> idle_ns{0};
+    latency_histogram queue_wait;   // enqueue to start
+    latency_histogram run_time;     // start to end, minus the time the task spent helping or parked in help_until
+    uint64_t nested_ns = 0;         // owner thread only: help_until time inside the running task, see execute
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+};
+
+struct threadpool_snapshot
+{
+    struct worker
+    {
+        uint64_t tasks = 0;
+        uint64_t steals = 0;
+        uint64_t parks = 0;
+        uint64_t busy_ns = 0;
+        uint64_t idle_ns = 0;
+        size_t queue_depth = 0;
+        latency_histogram::snapshot queue_wait;
+        latency_histogram::snapshot run_time;
+
+        // share of the time spent running tasks out of running plus parked, spinning counts as neither
+        double utilization() const { return busy_ns + idle_ns ? static_cast<double>(busy_ns) / (busy_ns + idle_ns) : 0.0; }
+    };
+
+    std::string name;
+    bool enabled = telemetry_enabled;
+    size_t global_queue_depth = 0;
+    std::vector<worker> workers;
+
+    latency_histogram::snapshot queue_wait() const
+    {
+        latency_histogram::snapshot total;
+        for (auto& w : workers) total.merge(w.queue_wait);
+        return total;
+    }
+
+    latency_histogram::snapshot run_time() const
+    {
+        latency_histogram::snapshot total;
+        for (auto& w : workers) total.merge(w.run_time);
+        return total;
+    }
+
+    // writes s as a JSON string literal, escaping quotes, backslashes and control characters
+    static void json_string(std::ostringstream& out, const std::string& s)
+    {
+        out << '"';
+        for (unsigned char c : s)
+        {
+            switch (c)
+            {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (c < 0x20)
+                {
+                    const char* hex = "0123456789abcdef";
+                    out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+                }
+                else out << c;
+            }
+        }
+        out << '"';
+    }
+
+    std::string to_json() const
+    {
+        auto histogram = [](std::ostringstream& out, const latency_histogram::snapshot& h)
+        {
+            out << "{\"count\": " << h.count << ", \"mean_ns\": " << h.mean() << ", \"p50_ns\": " << h.percentile(0.5)
+                << ", \"p90_ns\": " << h.percentile(0.9) << ", \"p99_ns\": " << h.percentile(0.99)
+                << ", \"p999_ns\": " << h.percentile(0.999) << ", \"max_ns\": " << h.max << "}";
+        };
+        std::ostringstream out;
+        out << "{\"name\": ";
+        json_string(out, name);
+        out << ", \"enabled\": " << (enabled ? "true" : "false")
+            << ", \"global_queue_depth\": " << global_queue_depth << ", \"queue_wait\": ";
+        histogram(out, queue_wait());
+        out << ", \"run_time\": ";
+        histogram(out, run_time());
+        out << ", \"workers\": [";
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            auto& w = workers[i];
+            out << (i ? ", " : "") << "{\"tasks\": " << w.tasks << ", \"steals\": " << w.steals << ", \"parks\": " << w.parks
+                << ", \"busy_ns\": " << w.busy_ns << ", \"idle_ns\": " << w.idle_ns << ", \"utilization\": " << w.utilization()
+                << ", \"queue_depth\": " << w.queue_depth << ", \"queue_wait\": ";
+            histogram(out, w.queue_wait);
+            out << ", \"run_time\": ";
+            histogram(out, w.run_time);
+            out << "}";
+        }
+        out << "]}";
+        return out.str();
+    }
+
+    bool dump(const std::string& path) const
+    {
+        std::ofstream file(path);
+        file << to_json() << std::endl;
+        return static_cast<bool>(file);
+    }
+};
@@ -1,5 +1,10 @@
 #pragma once
 #include "concurrent_queue.h"
+#include "topology.h"
+#include "small_function.h"
+#include "pool_allocator.h"
+#include "telemetry.h"
+#include "timer.h"
 
 #include <future>
 #include <thread>
@@ -8,104 +13,859 @@
 #include <iterator>
 #include <iostream>
 #include <latch>
+#include <mutex>
+#include <chrono>
+#include <concepts>
+#include <limits>
+#include <array>
+#include <string>
+#include <vector>
+
+// shared_queue: every task goes through the global queue
+// work_stealing: normal lane tasks submitted from a worker go to its own deque, popped LIFO by the owner and stolen
+//                FIFO by idle workers; the lane queues receive submissions from outside the pool and other lanes
+enum class threadpool_scheduling
+{
+    shared_queue,
+    work_stealing
+};
+
+// priority classes of tasks, each with its own queue
+enum class task_lane
+{
+    high,       // latency critical, e.g. request handling
+    normal,
+    low         // batch and background work
+};
+
+inline constexpr size_t task_lane_count = 3;
+
+// strict: a worker always takes the highest non-empty lane, low can starve under sustained high load
+// weighted: workers cycle through the lanes in proportion to lane_weights, falling back to the other lanes
+//           (highest first) when the chosen one is empty
+enum class threadpool_lane_order
+{
+    strict,
+    weighted
+};
+
+struct threadpool_config
+{
+    size_t threads = 0;                          // 0: one per cpu of numa_node, or per hardware thread
+    std::string name = "threadpool";             // workers are named "<name>-<index>"
+    std::vector<std::vector<int>> affinity;      // worker i is pinned to affinity[i % affinity.size()]
+    int numa_node = -1;                          // without explicit affinity, pin every worker to this node's cpus
+    threadpool_scheduling mode = threadpool_scheduling::work_stealing;
+    threadpool_lane_order lane_order = threadpool_lane_order::strict;
+    std::array<unsigned, task_lane_count> lane_weights{8, 4, 1}; // high, normal, low turns per cycle when weighted
+    size_t reserved_workers = 0;                 // workers that only run task_lane::high, at most threads - 1
+    // elastic: threads is the maximum. workers start on demand, a worker entering a threadpool::blocking_region gets
+    // a replacement, and workers beyond min_threads exit after idle_timeout without work
+    bool elastic = false;
+    size_t min_threads = 0;                      // elastic: workers kept once started, reserved workers always run
+    std::chrono::milliseconds idle_timeout{10000};
+    std::chrono::microseconds growth_interval{1000}; // elastic: a busy pool gains at most one worker per interval
+};
 
 class threadpool
 {
+    // tasks are move-only small_functions, typical lambdas are stored inline without allocating
+    using task_type = small_function<void()>;
+    // the ring_buffer keeps its storage when drained, mpmc_queue<task_type> is a lock-free drop-in
+    // when submitters contend on the spinlock
+    using task_queue = concurrent_queue<task_type, ring_buffer<task_type>>;
+
+    // shared with pending timers, which may fire after the pool is gone. the timer thread holds the mutex while it
+    // enqueues, so the destructor waits for a firing timer instead of racing with it
+    struct timer_anchor
+    {
+        std::mutex mutex;
+        threadpool* pool;
+
+        explicit timer_anchor(threadpool* p) : pool(p) {}
+    };
+
+    // the deques only hold normal lane tasks, high and low lane tasks always go through their lane queue
+    struct worker
+    {
+        work_stealing_deque<task_type*> local;
+        std::unique_ptr<worker_telemetry> stats; // only allocated with telemetry enabled
+        size_t turn = 0;                         // position in the weighted lane schedule
+    };
+
+    // set on worker threads so that submissions from inside a task can go to the worker's own deque
+    struct worker_context
+    {
+        threadpool* pool = nullptr;
+        size_t index = 0;
+    };
+
+    static worker_context& current()
+    {
+        thread_local worker_context context;
+        return context;
+    }
+
 public:
+    using scheduling = threadpool_scheduling;
+    using config = threadpool_config;
+
+    // default pool shared by task() and the parallel algorithms
     static threadpool* instance()
     {
         static threadpool tp;
         return &tp;
     }
 
+    explicit threadpool(const config& cfg = {}) : m_scheduling(cfg.mode), m_name(cfg.name), m_lane_order(cfg.lane_order)
+    {
+        for (size_t lane = 0; lane < task_lane_count; ++lane)
+            for (unsigned i = 0; i < std::max(1u, cfg.lane_weights[lane]); ++i) m_lane_schedule.push_back(static_cast<task_lane>(lane));
+        std::vector<int> node_cpus;
+        if (cfg.numa_node >= 0)
+        {
+            auto nodes = numa_nodes();
+            if (static_cast<size_t>(cfg.numa_node) < nodes.size()) node_cpus = nodes[cfg.numa_node];
+        }
+        size_t n_threads = cfg.threads ? cfg.threads : node_cpus.size() ? node_cpus.size() : std::max(1u, std::thread::hardware_concurrency());
+        m_workers.resize(n_threads);
+        m_threads.resize(n_threads);
+        m_slot_running.resize(n_threads);
+        m_reserved = std::min(cfg.reserved_workers, n_threads - 1);
+        for (size_t i = 0; i < n_threads; ++i)
+            m_cpus.push_back(cfg.affinity.empty() ? node_cpus : cfg.affinity[i % cfg.affinity.size()]);
+        m_elastic = cfg.elastic;
+        m_min_threads = std::min(std::max(cfg.min_threads, m_reserved), n_threads);
+        m_idle_timeout = cfg.idle_timeout;
+        m_growth_interval = cfg.growth_interval;
+        if (m_elastic)
+        {
+            // workers come and go, their deques stay so that thieves never see a missing one
+            for (auto& w : m_workers)
+            {
+                w = std::make_unique<worker>();
+                if constexpr (telemetry_enabled) w->stats = std::make_unique<worker_telemetry>();
+            }
+            m_started = true;
+            std::lock_guard<std::mutex> l(m_elastic_mutex);
+            for (size_t i = 0; i < m_reserved; ++i) start_worker(i, nullptr);
+            return;
+        }
+        // each worker pins itself before allocating its deque so that the memory is first touched on its own node
+        std::latch started(n_threads);
+        for (size_t i = 0; i < n_threads; ++i) start_worker(i, &started);
+        started.wait();
+        m_started = true;
+        m_started.notify_all();
+    }
+
+    threadpool(const threadpool&) = delete;
+    threadpool& operator=(const threadpool&) = delete;
+
     ~threadpool()
     {
+        {
+            std::lock_guard<std::mutex> l(m_timer_anchor->mutex);
+            m_timer_anchor->pool = nullptr;
+        }
         m_stop = true;
-        int n_threads = std::thread::hardware_concurrency();
-        for(int i = 0; i < n_threads; ++i)
+        m_parking.notify_all();
+        m_reserved_parking.notify_all();
+        // a worker retiring meanwhile needs m_elastic_mutex, join outside of it
+        std::vector<std::thread> threads;
         {
-            schedule([](){});
+            std::lock_guard<std::mutex> l(m_elastic_mutex);
+            threads.swap(m_threads);
         }
-        for(int i = 0; i < n_threads; ++i)
+        for(auto& t : threads)
         {
-            auto& t = m_workers[i];
             if (t.joinable()) t.join();
         }
+        for(auto& w : m_workers)
+        {
+            while (auto task = w->local.pop()) free_task(task.value());
+        }
     }
+
+    // f and args are moved into the task, the future's shared state comes from a recycling pool
     template<typename F, typename... Args>
-    std::future<std::invoke_result_t<F, Args...>> schedule(F&& f, Args&&... args)
+        requires (!std::is_same_v<std::decay_t<F>, task_lane>)
+    std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> schedule(F&& f, Args&&... args)
     {
-        using return_type = std::invoke_result_t<F, Args...>;
-        auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args...>(args...)));
-        auto ret = task->get_future();
-        m_tasks.push_and_notify([task]() { (*task)();}, [this](){ m_sem.release();});
+        return schedule(task_lane::normal, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    template<typename F, typename... Args>
+    std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> schedule(task_lane lane, F&& f, Args&&... args)
+    {
+        using return_type = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+        std::promise<return_type> promise(std::allocator_arg, recycling_allocator<return_type>{});
+        auto ret = promise.get_future();
+        enqueue([promise = std::move(promise), f = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable
+        {
+            try
+            {
+                if constexpr (std::is_void_v<return_type>)
+                {
+                    std::invoke(std::move(f), std::move(args)...);
+                    promise.set_value();
+                }
+                else promise.set_value(std::invoke(std::move(f), std::move(args)...));
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+        }, lane);
         return ret;
     }
+
+    // fire and forget: no allocation in steady state when f fits in task_type's inline storage
     template<typename F>
-    std::future<std::invoke_result_t<F>> schedule(F&& f)
+    void enqueue(F&& f, task_lane lane = task_lane::normal)
     {
-        using return_type = std::invoke_result_t<F>;
-        auto task = std::make_shared<std::packaged_task<return_type()>>([&]() { return f();});
-        auto ret = task->get_future();
-        m_tasks.push_and_notify([task]() { (*task)();}, [this](){ m_sem.release();});
-        return ret;
+        if constexpr (telemetry_enabled) submit(with_timestamp(std::forward<F>(f)), lane);
+        else submit(std::forward<F>(f), lane);
+    }
+
+    // like enqueue, but f always goes to the back of the lane queue, also when called from a worker whose own deque
+    // would run it next. for a task that hands its worker back on purpose, such as the next batch of a strand
+    template<typename F>
+    void enqueue_back(F&& f, task_lane lane = task_lane::normal)
+    {
+        if constexpr (telemetry_enabled) submit(with_timestamp(std::forward<F>(f)), lane, false);
+        else submit(std::forward<F>(f), lane, false);
     }
 
-    void enqueue(const std::function<void()>& f)
+    // one queue lock for the whole batch, wakes as many sleeping workers as there are new tasks
+    template<std::ranges::input_range R>
+    void enqueue_bulk(R&& tasks, task_lane lane = task_lane::normal)
     {
-        m_tasks.push_and_notify(f, [this](){ m_sem.release();});
+        if constexpr (telemetry_enabled)
+        {
+            std::vector<task_type> timed;
+            for (auto&& task : tasks)
+            {
+                if constexpr (std::is_lvalue_reference_v<R>) timed.emplace_back(with_timestamp(task));
+                else timed.emplace_back(with_timestamp(std::move(task)));
+            }
+            submit_bulk(std::move(timed), lane);
+        }
+        else submit_bulk(std::forward<R>(tasks), lane);
+    }
+
+    // f is enqueued once `when` has passed, the timer itself does not hold a worker.
+    // timers that fire after the pool is destroyed drop f without running it
+    template<typename F>
+    void schedule_at(timer_wheel::clock::time_point when, F&& f, task_lane lane = task_lane::normal)
+    {
+        timer_wheel::instance().schedule_at(when, [anchor = m_timer_anchor, lane, f = std::forward<F>(f)]() mutable
+        {
+            std::lock_guard<std::mutex> l(anchor->mutex);
+            if (anchor->pool) anchor->pool->enqueue(std::move(f), lane);
+        });
+    }
+
+    template<typename Rep, typename Period, typename F>
+    void schedule_after(std::chrono::duration<Rep, Period> delay, F&& f, task_lane lane = task_lane::normal)
+    {
+        schedule_at(timer_wheel::clock::now() + std::chrono::duration_cast<timer_wheel::clock::duration>(delay), std::forward<F>(f), lane);
+    }
+
+    // worker slots, the maximum number of threads of an elastic pool
+    size_t size() const { return m_workers.size(); }
+    // threads currently running, size() unless elastic
+    size_t threads() const { return m_live.load(std::memory_order_relaxed); }
+    const std::string& name() const { return m_name; }
+
+    // on a worker of this pool: runs queued tasks until done() holds, so that a task waiting for other tasks (a nested
+    // parallel_for, a task_graph run) keeps its worker in service and nested waits always make progress.
+    // the tasks run meanwhile must not themselves wait for something only the caller's frame can do.
+    // returns false right away when called from any other thread, which should then block as usual.
+    // with nothing to run it spins for a while, then parks like an idle worker. whatever makes done() true does not
+    // notify the pool, so a parked helper wakes every help_park_interval to check it
+    template<typename Pred>
+    bool help_until(Pred done)
+    {
+        auto& context = current();
+        if (context.pool != this) return false;
+        size_t index = context.index;
+        auto& parking = index < m_reserved ? m_reserved_parking : m_parking;
+        spin_backoff backoff;
+        size_t idle_rounds = 0;
+        while (!done())
+        {
+            if (auto task = next_task(index))
+            {
+                execute(index, task.value());
+                backoff = {};
+                idle_rounds = 0;
+                continue;
+            }
+            if (idle_rounds++ < spin_rounds)
+            {
+                backoff();
+                continue;
+            }
+            auto key = parking.prepare_wait();
+            if (done())
+            {
+                parking.cancel_wait();
+                break;
+            }
+            if (auto task = next_task(index))
+            {
+                parking.cancel_wait();
+                execute(index, task.value());
+                backoff = {};
+                idle_rounds = 0;
+                continue;
+            }
+            auto start = telemetry_clock::now();
+            bool notified = parking.wait_for(key, help_park_interval);
+            if constexpr (telemetry_enabled)
+            {
+                auto& stats = *m_workers[index]->stats;
+                uint64_t parked = std::chrono::duration_cast<std::chrono::nanoseconds>(telemetry_clock::now() - start).count();
+                worker_telemetry::add(stats.parks, 1);
+                worker_telemetry::add(stats.idle_ns, parked);
+                stats.nested_ns += parked;
+            }
+            // a wakeup meant for a task that this helper leaves queued is passed on to another worker
+            if (notified && done() && has_work()) parking.notify(1);
+        }
+        return true;
+    }
+
+    // declares that the calling task is about to block on something other than the pool (std::future::get, a lock
+    // held by a slow thread, io). on a worker of an elastic pool that has no idle worker left, a replacement starts
+    // right away instead of after growth_interval; it retires after idle_timeout once the pool is quiet again
+    class blocking_region
+    {
+    public:
+        blocking_region()
+        {
+            threadpool* pool = current().pool;
+            if (pool && pool->m_elastic && pool->m_idle.load(std::memory_order_seq_cst) == 0) pool->grow(true);
+        }
+
+        blocking_region(const blocking_region&) = delete;
+        blocking_region& operator=(const blocking_region&) = delete;
+    };
+
+    // queue depths, plus per-worker counters and latency histograms when built with THREADPOOL_TELEMETRY
+    threadpool_snapshot telemetry()
+    {
+        threadpool_snapshot snapshot;
+        snapshot.name = m_name;
+        for (auto& lane : m_lanes) snapshot.global_queue_depth += lane.size();
+        for (auto& w : m_workers)
+        {
+            threadpool_snapshot::worker stats;
+            stats.queue_depth = w->local.size();
+            if constexpr (telemetry_enabled)
+            {
+                stats.tasks = w->stats->tasks.load(std::memory_order_relaxed);
+                stats.steals = w->stats->steals.load(std::memory_order_relaxed);
+                stats.parks = w->stats->parks.load(std::memory_order_relaxed);
+                stats.busy_ns = w->stats->busy_ns.load(std::memory_order_relaxed);
+                stats.idle_ns = w->stats->idle_ns.load(std::memory_order_relaxed);
+                stats.queue_wait = w->stats->queue_wait.read();
+                stats.run_time = w->stats->run_time.read();
+            }
+            snapshot.workers.push_back(std::move(stats));
+        }
+        return snapshot;
     }
 private:
-    threadpool()
+    template<typename F>
+    void submit(F&& f, task_lane lane, bool local = true)
     {
-        int n_threads = std::thread::hardware_concurrency();
-        for(int i = 0; i < n_threads; ++i)
+        worker* w = local && lane == task_lane::normal ? local_worker() : nullptr;
+        if (w) w->local.push(make_task(std::forward<F>(f)));
+        else m_lanes[static_cast<size_t>(lane)].emplace(std::forward<F>(f));
+        notify(lane, 1);
+    }
+
+    // high lane tasks can run on reserved workers as well as on the others.
+    // the fence in event_count::notify orders the push before the load of m_idle, and a worker counts itself idle
+    // before its next look at the queues: either that worker finds the task or an elastic pool grows
+    void notify(task_lane lane, size_t n)
+    {
+        if (lane == task_lane::high && m_reserved) m_reserved_parking.notify(n);
+        m_parking.notify(n);
+        if (m_elastic && m_idle.load(std::memory_order_seq_cst) == 0) grow(false);
+    }
+
+    void start_worker(size_t i, std::latch* started)
+    {
+        m_slot_running[i] = true;
+        m_live.fetch_add(1, std::memory_order_relaxed);
+        m_threads[i] = std::thread([this, i, started]()
         {
-            std::thread t([this]()
+            if (!m_cpus[i].empty()) pin_current_thread(m_cpus[i]);
+            name_current_thread(m_name + "-" + std::to_string(i));
+            if (!m_workers[i])
             {
-                while (!m_stop)
-                {
-                    m_sem.acquire();
-                    auto task = m_tasks.pop();
-                    if (task) task.value()();
-                }
-            });
-            m_workers.push_back(std::move(t));
+                m_workers[i] = std::make_unique<worker>();
+                if constexpr (telemetry_enabled) m_workers[i]->stats = std::make_unique<worker_telemetry>();
+            }
+            if (started) started->count_down();
+            // idle workers steal from every deque, wait until all of them exist
+            m_started.wait(false);
+            run(i);
+        });
+    }
+
+    // elastic only: starts a worker in a free slot. without compensate, at most once per growth interval unless
+    // only reserved workers run, so that a short burst does not start every slot
+    void grow(bool compensate)
+    {
+        // every slot is live: nothing to start, and this is the common case on the submit path of a saturated pool
+        if (m_live.load(std::memory_order_relaxed) >= m_workers.size()) return;
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        if (!compensate && m_live.load(std::memory_order_relaxed) > m_reserved
+            && now - std::chrono::steady_clock::duration(m_last_growth.load(std::memory_order_relaxed)) < m_growth_interval)
+        {
+            check_growth_later();
+            return;
+        }
+        std::lock_guard<std::mutex> l(m_elastic_mutex);
+        if (m_stop.load(std::memory_order_relaxed)) return;
+        for (size_t i = m_reserved; i < m_slot_running.size(); ++i)
+        {
+            if (m_slot_running[i]) continue;
+            // a retired worker clears its slot as its last step, joining it does not wait for long
+            if (m_threads[i].joinable()) m_threads[i].join();
+            start_worker(i, nullptr);
+            m_last_growth.store(now.count(), std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    // a backlog still waiting for a worker one growth interval later grows the pool, even when nothing is submitted
+    // meanwhile (every worker stuck in tasks that wait for queued ones). one check is pending at a time, it re-arms
+    // while the backlog lasts and slots are free
+    void check_growth_later()
+    {
+        if (m_growth_check.exchange(true, std::memory_order_relaxed)) return;
+        timer_wheel::instance().schedule_after(m_growth_interval, [anchor = m_timer_anchor]()
+        {
+            std::lock_guard<std::mutex> l(anchor->mutex);
+            threadpool* pool = anchor->pool;
+            if (!pool) return;
+            pool->m_growth_check.store(false, std::memory_order_relaxed);
+            if (pool->m_idle.load(std::memory_order_seq_cst) != 0 || !pool->has_work()) return;
+            pool->grow(false);
+            if (pool->m_live.load(std::memory_order_relaxed) < pool->size()) pool->check_growth_later();
+        });
+    }
+
+    // elastic only, called by an idle worker whose park timed out; true when the worker must exit
+    bool retire(size_t index)
+    {
+        {
+            std::lock_guard<std::mutex> l(m_elastic_mutex);
+            if (m_stop.load(std::memory_order_relaxed) || index < m_reserved || m_live.load(std::memory_order_relaxed) <= m_min_threads)
+                return false;
+            m_live.fetch_sub(1, std::memory_order_relaxed);
+        }
+        // pairs with notify(): a submitter that still counted this worker as idle pushed before our look at the queues
+        m_idle.fetch_sub(1, std::memory_order_seq_cst);
+        if (has_work())
+        {
+            m_idle.fetch_add(1, std::memory_order_seq_cst);
+            m_live.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // the slot stays taken until here, so grow() never joins a worker that may still come back
+        std::lock_guard<std::mutex> l(m_elastic_mutex);
+        m_slot_running[index] = false;
+        return true;
+    }
+
+    bool has_work()
+    {
+        for (auto& lane : m_lanes)
+            if (!lane.empty()) return true;
+        for (auto& w : m_workers)
+            if (!w->local.empty()) return true;
+        return false;
+    }
+
+    template<std::ranges::input_range R>
+    void submit_bulk(R&& tasks, task_lane lane)
+    {
+        worker* w = lane == task_lane::normal ? local_worker() : nullptr;
+        if (w)
+        {
+            size_t n = 0;
+            for (auto&& task : tasks)
+            {
+                if constexpr (std::is_lvalue_reference_v<R>) w->local.push(make_task(task));
+                else w->local.push(make_task(std::move(task)));
+                ++n;
+            }
+            notify(lane, n);
+        }
+        else m_lanes[static_cast<size_t>(lane)].push_bulk_and_notify(std::forward<R>(tasks), [this, lane](size_t n){ notify(lane, n); });
+    }
+
+    // the worker that starts the task records how long it was queued
+    template<typename F>
+    auto with_timestamp(F&& f)
+    {
+        return [this, queued = telemetry_clock::now(), f = std::forward<F>(f)]() mutable
+        {
+            if (context_worker()) context_worker()->stats->queue_wait.record(telemetry_clock::now() - queued);
+            f();
+        };
+    }
+
+    // a task waiting in help_until runs other tasks and may park meanwhile. those are recorded on their own (as tasks,
+    // as idle time) and add to nested_ns, which the waiting task then takes out of its own run time, so nothing is
+    // counted twice. the whole task counts as nested for a task that is itself waiting further up the stack
+    void execute(size_t index, task_type& task)
+    {
+        if constexpr (telemetry_enabled)
+        {
+            auto& stats = *m_workers[index]->stats;
+            uint64_t nested_before = stats.nested_ns;
+            auto start = telemetry_clock::now();
+            task();
+            uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(telemetry_clock::now() - start).count();
+            uint64_t own = elapsed - std::min(elapsed, stats.nested_ns - nested_before);
+            stats.nested_ns = nested_before + elapsed;
+            stats.run_time.record(own);
+            worker_telemetry::add(stats.tasks, 1);
+            worker_telemetry::add(stats.busy_ns, own);
+        }
+        else task();
+    }
+
+    // false when an elastic worker that may retire saw no notification for idle_timeout
+    bool park(event_count& parking, event_count::key key, size_t index)
+    {
+        auto start = telemetry_clock::now();
+        bool notified = true;
+        if (m_elastic && index >= m_reserved) notified = parking.wait_until(key, start + m_idle_timeout);
+        else parking.wait(key);
+        if constexpr (telemetry_enabled)
+        {
+            auto& stats = *m_workers[index]->stats;
+            worker_telemetry::add(stats.parks, 1);
+            worker_telemetry::add(stats.idle_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(telemetry_clock::now() - start).count());
+        }
+        return notified;
+    }
+
+    // polls of the queues between running out of work and parking
+    static constexpr size_t spin_rounds = 64;
+    // how often a parked help_until caller rechecks its condition
+    static constexpr auto help_park_interval = std::chrono::microseconds(200);
+
+    // tasks parked in the work-stealing deques live in recycled blocks
+    template<typename F>
+    static task_type* make_task(F&& f)
+    {
+        return new (recycling_allocator<task_type>{}.allocate(1)) task_type(std::forward<F>(f));
+    }
+
+    static task_type take_task(task_type* task)
+    {
+        task_type f(std::move(*task));
+        task->~task_type();
+        recycling_allocator<task_type>{}.deallocate(task, 1);
+        return f;
+    }
+
+    static void free_task(task_type* task)
+    {
+        take_task(task);
+    }
+
+    // a worker drains every queue it can reach, spins for a while in case more work shows up right away, and only
+    // then parks. it registers with m_parking before its last look at the queues, so a task pushed after that look
+    // always wakes it
+    void run(size_t index)
+    {
+        current() = {this, index};
+        // elastic pools count the non-reserved workers looking for work, notify() grows the pool when there are none
+        bool idle = false;
+        auto set_idle = [&](bool value)
+        {
+            if (!m_elastic || index < m_reserved || idle == value) return;
+            idle = value;
+            if (value) m_idle.fetch_add(1, std::memory_order_seq_cst);
+            else m_idle.fetch_sub(1, std::memory_order_seq_cst);
+        };
+        auto run_task = [&](task_type& task)
+        {
+            set_idle(false);
+            execute(index, task);
+        };
+        while (!m_stop.load(std::memory_order_relaxed))
+        {
+            if (auto task = next_task(index))
+            {
+                run_task(task.value());
+                continue;
+            }
+            set_idle(true);
+            if (auto task = spin_for_task(index))
+            {
+                run_task(task.value());
+                continue;
+            }
+            auto& parking = index < m_reserved ? m_reserved_parking : m_parking;
+            auto key = parking.prepare_wait();
+            if (m_stop.load(std::memory_order_relaxed))
+            {
+                parking.cancel_wait();
+                break;
+            }
+            if (auto task = next_task(index))
+            {
+                parking.cancel_wait();
+                run_task(task.value());
+                continue;
+            }
+            // retire() takes the worker out of the idle count itself
+            if (!park(parking, key, index) && retire(index)) return;
         }
+        set_idle(false);
+    }
+
+    std::optional<task_type> spin_for_task(size_t index)
+    {
+        spin_backoff backoff;
+        for (size_t i = 0; i < spin_rounds && !m_stop.load(std::memory_order_relaxed); ++i)
+        {
+            backoff();
+            if (auto task = next_task(index)) return task;
+        }
+        return std::nullopt;
+    }
+
+    // the worker of this pool running the calling thread, whatever the scheduling mode
+    worker* context_worker()
+    {
+        auto& context = current();
+        return context.pool == this ? m_workers[context.index].get() : nullptr;
+    }
+
+    // reserved workers never queue locally, their deque would only be drained by thieves
+    worker* local_worker()
+    {
+        auto& context = current();
+        if (m_scheduling == scheduling::work_stealing && context.pool == this && context.index >= m_reserved)
+            return m_workers[context.index].get();
+        return nullptr;
+    }
+
+    // reserved workers only look at the high lane. the others start with the highest lane (strict) or the lane of
+    // their next weighted turn, then try the remaining lanes from high to low
+    std::optional<task_type> next_task(size_t index)
+    {
+        if (index < m_reserved) return m_lanes[static_cast<size_t>(task_lane::high)].pop();
+        task_lane first = task_lane::high;
+        if (m_lane_order == threadpool_lane_order::weighted)
+        {
+            worker& w = *m_workers[index];
+            first = m_lane_schedule[w.turn++ % m_lane_schedule.size()];
+        }
+        if (auto task = next_task(index, first)) return task;
+        for (size_t lane = 0; lane < task_lane_count; ++lane)
+        {
+            if (static_cast<task_lane>(lane) == first) continue;
+            if (auto task = next_task(index, static_cast<task_lane>(lane))) return task;
+        }
+        return std::nullopt;
+    }
+
+    // normal lane: own deque first (newest task, hot in cache), then the lane queue, then steal the oldest task of a
+    // random victim
+    std::optional<task_type> next_task(size_t index, task_lane lane)
+    {
+        if (lane != task_lane::normal) return m_lanes[static_cast<size_t>(lane)].pop();
+        if (auto task = m_workers[index]->local.pop())
+            return take_task(task.value());
+        if (auto task = m_lanes[static_cast<size_t>(lane)].pop()) return task;
+        if (m_scheduling != scheduling::work_stealing) return std::nullopt;
+        thread_local uint64_t rng = 0x9e3779b97f4a7c15ull ^ index;
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t n = m_workers.size();
+        for (size_t i = 0, start = rng % n; i < n; ++i)
+        {
+            size_t victim = (start + i) % n;
+            if (victim == index) continue;
+            if (auto task = m_workers[victim]->local.steal())
+            {
+                if constexpr (telemetry_enabled) worker_telemetry::add(m_workers[index]->stats->steals, 1);
+                return take_task(task.value());
+            }
+        }
+        return std::nullopt;
     }
 private:
-    std::vector<std::thread> m_workers;
-    concurrent_queue<std::function<void()>> m_tasks;
-    std::binary_semaphore m_sem{0};
-    bool m_stop{false};
+    scheduling m_scheduling;
+    std::string m_name;
+    std::vector<std::unique_ptr<worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    threadpool_lane_order m_lane_order;
+    std::vector<task_lane> m_lane_schedule;
+    size_t m_reserved = 0;
+    std::array<task_queue, task_lane_count> m_lanes;
+    event_count m_parking;
+    event_count m_reserved_parking;
+    std::shared_ptr<timer_anchor> m_timer_anchor = std::make_shared<timer_anchor>(this);
+    std::atomic<bool> m_started{false};
+    std::atomic<bool> m_stop{false};
+    std::vector<std::vector<int>> m_cpus;        // affinity of each slot
+    std::atomic<size_t> m_live{0};
+    // elastic pools only
+    bool m_elastic = false;
+    size_t m_min_threads = 0;
+    std::chrono::milliseconds m_idle_timeout{};
+    std::chrono::microseconds m_growth_interval{};
+    std::mutex m_elastic_mutex;                  // m_threads and m_slot_running
+    std::vector<bool> m_slot_running;
+    std::atomic<size_t> m_idle{0};               // workers spinning or parked
+    std::atomic<std::chrono::steady_clock::rep> m_last_growth{0};
+    std::atomic<bool> m_growth_check{false};
 };
 
-// template< std::input_iterator I, std::sentinel_for<I> S, class Proj = std::identity,
-//           std::indirectly_unary_invocable<std::projected<I, Proj>> Fun >
-template <typename Iterator, typename Fun>
-void parallel_for(Iterator first, Iterator last, Fun f)
+namespace details
 {
-    static const int RANGE_SIZE = 128;
-    std::latch work_done((std::distance(first, last) + RANGE_SIZE - 1)/RANGE_SIZE);
-    auto next = first;
-    for (;next != last;std::advance(first, RANGE_SIZE))
+// shared by parallel_for_chunks and parallel_for_chunks_until, documented below
+template <bool Stoppable, typename Body>
+void run_chunks(size_t n, Body body, size_t grain, threadpool* pool, task_lane lane)
+{
+    static constexpr bool with_slot = std::is_invocable_v<Body&, size_t, size_t, size_t>;
+    using result = std::conditional_t<with_slot, std::invoke_result<Body&, size_t, size_t, size_t>, std::invoke_result<Body&, size_t, size_t>>::type;
+    static_assert(!Stoppable || std::same_as<result, bool>, "parallel_for_chunks_until needs a body returning bool");
+    using namespace std::chrono_literals;
+    static constexpr auto target_chunk_time = 50us;
+    if (n == 0) return;
+    size_t n_tasks = std::min(pool->size() + 1, grain ? (n + grain - 1) / grain : n);
+    std::atomic<size_t> cursor{0};
+    std::latch work_done(n_tasks);
+    auto worker = [&](size_t slot)
     {
-        if (std::distance(first, last) < RANGE_SIZE) next = last; else std::advance(next, RANGE_SIZE);
-        auto wrapf = [=, &work_done]() 
+        size_t chunk = grain ? grain : 1;
+        while (true)
         {
-            for(auto it = first;it != next;++it)
-                std::invoke(f, *it);
-            work_done.count_down();
-        };
-        threadpool::instance()->enqueue(wrapf);
-    }
-    work_done.wait();
+            size_t remaining_cap = grain ? grain : std::max<size_t>(1, (n - std::min(n, cursor.load(std::memory_order_relaxed))) / (2 * n_tasks));
+            size_t size = std::min(chunk, remaining_cap);
+            size_t begin = cursor.fetch_add(size, std::memory_order_relaxed);
+            if (begin >= n) break;
+            size_t end = std::min(n, begin + size);
+            auto start = std::chrono::steady_clock::now();
+            bool more = true;
+            if constexpr (with_slot && Stoppable) more = body(slot, begin, end);
+            else if constexpr (with_slot) body(slot, begin, end);
+            else if constexpr (Stoppable) more = body(begin, end);
+            else body(begin, end);
+            if (!more) break;
+            if (!grain)
+            {
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                if (elapsed < target_chunk_time) chunk *= 2;
+                else if (elapsed > 4 * target_chunk_time && chunk > 1) chunk /= 2;
+            }
+        }
+        work_done.count_down();
+    };
+    std::vector<small_function<void()>> tasks;
+    tasks.reserve(n_tasks - 1);
+    for (size_t i = 1; i < n_tasks; ++i) tasks.emplace_back([&worker, i]() { worker(i); });
+    pool->enqueue_bulk(std::move(tasks), lane);
+    worker(0);
+    if (!pool->help_until([&]() { return work_done.try_wait(); })) work_done.wait();
+}
+}
+
+// adaptive partitioner behind every parallel_for: one task per worker (the caller runs one of them), each task
+// repeatedly claims the next chunk of [0, n) from a shared cursor and calls body(begin, end)
+// called from a worker, the caller runs other queued tasks while it waits, so nested calls cannot stall the pool
+// grain == 0: chunks start at one element and double while a chunk runs faster than target_chunk_time, so
+//             nanosecond bodies end up in large chunks and millisecond bodies in single elements; near the end
+//             chunks shrink to a fraction of what is left so that the workers finish together
+// grain > 0:  fixed chunk size
+// body may also take the slot (0 .. pool->size()) of the task running it first, for per-worker state.
+// whatever body returns is ignored, see parallel_for_chunks_until for bodies that stop early
+template <typename Body>
+void parallel_for_chunks(size_t n, Body body, size_t grain = 0, threadpool* pool = threadpool::instance(), task_lane lane = task_lane::normal)
+{
+    details::run_chunks<false>(n, std::move(body), grain, pool, lane);
 }
 
+// parallel_for_chunks for a body returning bool: false stops its task from claiming further chunks, the other
+// tasks carry on until they stop too or the index space is used up
+template <typename Body>
+void parallel_for_chunks_until(size_t n, Body body, size_t grain = 0, threadpool* pool = threadpool::instance(), task_lane lane = task_lane::normal)
+{
+    details::run_chunks<true>(n, std::move(body), grain, pool, lane);
+}
 
-// template<std::ranges::input_range R, class Proj = std::identity,
-//           std::indirectly_unary_invocable<std::projected<std::ranges::iterator_t<R>, Proj>> Fun >
-// void parallel_for(R&& r, Fun f, Proj proj = {})
-// {
+// integer index space [first, last)
+template <std::integral Index, typename Fun>
+void parallel_for(Index first, Index last, Fun f, size_t grain = 0)
+{
+    if (last <= first) return;
+    parallel_for_chunks(static_cast<size_t>(last - first), [&](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; ++i)
+            std::invoke(f, static_cast<Index>(first + i));
+    }, grain);
+}
 
-// }
\ No newline at end of file
+template <std::random_access_iterator Iterator, std::sized_sentinel_for<Iterator> Sentinel, typename Fun>
+void parallel_for(Iterator first, Sentinel last, Fun f, size_t grain = 0)
+{
+    parallel_for_chunks(static_cast<size_t>(last - first), [&](size_t b, size_t e)
+    {
+        for (auto it = first + b, end = first + e; it != end; ++it)
+            std::invoke(f, *it);
+    }, grain);
+}
+
+// without random access the range is walked once to record chunk boundaries, then the chunks are spread out.
+// grain == 0: chunks start at one element; whenever 16 per task are recorded, neighbours are merged and the chunk
+//             size doubles, which ends with 8 to 16 chunks per task without knowing the length up front
+template <std::forward_iterator Iterator, std::sentinel_for<Iterator> Sentinel, typename Fun>
+    requires (!std::random_access_iterator<Iterator> || !std::sized_sentinel_for<Sentinel, Iterator>)
+void parallel_for(Iterator first, Sentinel last, Fun f, size_t grain = 0)
+{
+    const size_t max_chunks = grain ? std::numeric_limits<size_t>::max() : 16 * (threadpool::instance()->size() + 1);
+    if (!grain) grain = 1;
+    std::vector<Iterator> bounds;
+    size_t i = 0;
+    for (auto it = first; it != last; ++it, ++i)
+    {
+        if (i % grain) continue;
+        if (bounds.size() == max_chunks)
+        {
+            // i is max_chunks * grain here, a multiple of the doubled grain as well
+            for (size_t k = 0; k < bounds.size() / 2; ++k) bounds[k] = bounds[2 * k];
+            bounds.erase(bounds.begin() + bounds.size() / 2, bounds.end());
+            grain *= 2;
+        }
+        bounds.push_back(it);
+    }
+    parallel_for_chunks(bounds.size(), [&](size_t b, size_t e)
+    {
+        auto it = bounds[b];
+        for (size_t c = b; c < e; ++c)
+            for (size_t k = 0; k < grain && it != last; ++k, ++it)
+                std::invoke(f, *it);
+    }, 1);
+}
+
+template <std::ranges::forward_range R, typename Fun>
+void parallel_for(R&& r, Fun f, size_t grain = 0)
+{
+    parallel_for(std::ranges::begin(r), std::ranges::end(r), std::move(f), grain);
+}
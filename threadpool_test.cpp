@@ -1,6 +1,8 @@
 #include "threadpool.h"
 
 #include <gtest/gtest.h>
+#include <forward_list>
+#include <list>
 
 TEST(threadpool, test1)
 {
@@ -15,3 +17,331 @@ TEST(threadpool, test1)
     std::this_thread::sleep_for(1000ms);
     ASSERT_EQ(1, 1);
 }
+
+TEST(threadpool, parallel_for_bulk)
+{
+    std::vector<int> v(10000, 1);
+    std::atomic<int> sum{0};
+    parallel_for(v.begin(), v.end(), [&](int val) { sum += val; });
+    ASSERT_EQ(sum.load(), 10000);
+}
+
+void spawn_tree(threadpool* pool, int depth, std::atomic<int>& done)
+{
+    if (depth > 0)
+    {
+        pool->enqueue([=, &done]() { spawn_tree(pool, depth - 1, done); });
+        pool->enqueue([=, &done]() { spawn_tree(pool, depth - 1, done); });
+    }
+    done++;
+}
+
+TEST(threadpool, recursive_tasks)
+{
+    using namespace std::literals;
+    std::atomic<int> done{0};
+    auto pool = threadpool::instance();
+    pool->enqueue([&]() { spawn_tree(pool, 10, done); });
+    for(int i = 0; i < 500 && done.load() < (1 << 11) - 1; i++)
+        std::this_thread::sleep_for(10ms);
+    ASSERT_EQ(done.load(), (1 << 11) - 1);
+}
+
+TEST(threadpool, config)
+{
+    ASSERT_EQ(parse_cpu_list("0-3,8,10-11"), std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    ASSERT_FALSE(numa_nodes().empty());
+
+    threadpool pool({.threads = 2, .name = "ingest", .affinity = {{0}}, .mode = threadpool::scheduling::shared_queue});
+    ASSERT_EQ(pool.size(), 2);
+    auto result = pool.schedule([]()
+    {
+        char name[16] = {};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        return std::string(name);
+    });
+    ASSERT_EQ(result.get().rfind("ingest-", 0), 0);
+}
+
+TEST(threadpool, enqueue_without_allocation)
+{
+    // one worker, busy until the whole burst is queued: every burst reaches the same queue depth, so whatever the
+    // first one grew is enough for the second
+    threadpool pool({.threads = 1});
+    const int n = 1000;
+    std::atomic<int> done{0};
+    // submitted from outside the pool the tasks go through the lane queue, from a task they go to the worker's deque
+    auto burst = [&](bool from_worker, auto make_task)
+    {
+        done = 0;
+        auto submit = [&]() { for (int i = 0; i < n; i++) pool.enqueue(make_task()); };
+        if (from_worker) pool.enqueue(submit);
+        else
+        {
+            std::latch queued(1);
+            pool.enqueue([&]() { queued.wait(); });
+            submit();
+            queued.count_down();
+        }
+        while (done.load() < n) std::this_thread::yield();
+    };
+    auto small = [&]() { return [&done]() { done++; }; };
+    for (bool from_worker : {false, true})
+    {
+        // the pool's lane queue and deque start small, the first burst has to grow the one it goes through
+        size_t before = task_path_allocations.load();
+        burst(from_worker, small);
+        ASSERT_GT(task_path_allocations.load(), before);
+        before = task_path_allocations.load();
+        burst(from_worker, small);
+        ASSERT_EQ(task_path_allocations.load(), before);
+    }
+
+    // a capture too big for small_function's inline storage is counted, so the checks above can fail
+    auto big = [&]() { return [&done, pad = std::array<char, 200>{}]() { done += 1 + pad[0]; }; };
+    size_t before = task_path_allocations.load();
+    burst(true, big);
+    ASSERT_GE(task_path_allocations.load() - before, static_cast<size_t>(n));
+}
+
+TEST(threadpool, schedule_with_arguments)
+{
+    threadpool pool({.threads = 2});
+    auto result = pool.schedule([](int a, int b) { return a + b; }, 1, 2);
+    ASSERT_EQ(result.get(), 3);
+}
+
+TEST(threadpool, parallel_for_overloads)
+{
+    std::atomic<long long> sum{0};
+    parallel_for(0, 100000, [&](int i) { sum += i; });
+    ASSERT_EQ(sum.load(), 100000LL * 99999 / 2);
+
+    std::list<int> l(1000, 2);
+    sum = 0;
+    parallel_for(l.begin(), l.end(), [&](int val) { sum += val; });
+    ASSERT_EQ(sum.load(), 2000);
+
+    std::vector<int> v(1000);
+    parallel_for(v, [](int& val) { val = 3; }, 7);
+    ASSERT_EQ(std::count(v.begin(), v.end(), 3), 1000);
+
+    sum = 0;
+    parallel_for(std::views::iota(0, 100), [&](int i) { sum += i; });
+    ASSERT_EQ(sum.load(), 4950);
+
+    // forward-only ranges of every size around the chunk merges: each element exactly once
+    for (size_t n : {0, 1, 7, 1000, 12345})
+    {
+        std::forward_list<std::atomic<int>> visits(n);
+        parallel_for(visits.begin(), visits.end(), [](std::atomic<int>& v) { v++; });
+        ASSERT_TRUE(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int>& v) { return v.load() == 1; }));
+    }
+}
+
+TEST(threadpool, parallel_for_chunks_results)
+{
+    // a body that happens to return something falsy still covers the whole index space
+    std::atomic<size_t> sum{0};
+    parallel_for_chunks(1000, [&](size_t b, size_t e) { sum += e - b; return 0; });
+    ASSERT_EQ(sum.load(), 1000u);
+    sum = 0;
+    parallel_for_chunks(1000, [&](size_t, size_t b, size_t e) { sum += e - b; return nullptr; });
+    ASSERT_EQ(sum.load(), 1000u);
+
+    // only the _until variant stops: a single task that gives up after its first chunk
+    threadpool pool({.threads = 1, .name = "until"});
+    sum = 0;
+    parallel_for_chunks_until(1000, [&](size_t b, size_t e) { sum += e - b; return false; }, 10, &pool);
+    ASSERT_LE(sum.load(), 20u);
+}
+
+TEST(threadpool, burst_wakes_every_worker)
+{
+    // every task blocks until all of them run at the same time, so each submission must wake its own sleeper
+    threadpool pool(threadpool::config{.threads = 4, .name = "burst"});
+    for (int round = 0; round < 20; ++round)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::latch together(4);
+        std::latch done(4);
+        for (int i = 0; i < 4; ++i)
+            pool.enqueue([&]() { together.arrive_and_wait(); done.count_down(); });
+        done.wait();
+    }
+}
+
+TEST(threadpool, telemetry)
+{
+    latency_histogram h;
+    for (uint64_t ns = 1; ns <= 100000; ++ns) h.record(ns);
+    auto s = h.read();
+    ASSERT_EQ(s.count, 100000u);
+    ASSERT_EQ(s.max, 100000u);
+    ASSERT_EQ(s.percentile(0.00001), 1u);
+    // buckets are at most 1/16 wide
+    ASSERT_NEAR(static_cast<double>(s.percentile(0.5)), 50000.0, 50000.0 / 16);
+    ASSERT_NEAR(static_cast<double>(s.percentile(0.99)), 99000.0, 99000.0 / 16);
+    for (size_t b = 1; b < latency_histogram::bucket_count; ++b)
+        ASSERT_EQ(latency_histogram::bucket_of(latency_histogram::bucket_value(b)), b);
+
+    threadpool pool(threadpool::config{.threads = 2, .name = "metered"});
+    std::latch done(100);
+    for (int i = 0; i < 100; ++i) pool.enqueue([&]() { done.count_down(); });
+    done.wait();
+    auto snapshot = pool.telemetry();
+    ASSERT_EQ(snapshot.workers.size(), 2u);
+    ASSERT_EQ(snapshot.enabled, telemetry_enabled);
+    if constexpr (telemetry_enabled)
+    {
+        // the last task may still be between count_down and its run time being recorded
+        ASSERT_GE(snapshot.run_time().count, 99u);
+        ASSERT_EQ(snapshot.queue_wait().count, 100u);
+    }
+    auto json = snapshot.to_json();
+    ASSERT_EQ(json.front(), '{');
+    ASSERT_NE(json.find("\"name\": \"metered\""), std::string::npos);
+    snapshot.name = "a\"b\\c\n";
+    ASSERT_NE(snapshot.to_json().find(R"("name": "a\"b\\c\n")"), std::string::npos);
+}
+
+TEST(threadpool, telemetry_nested)
+{
+    using namespace std::chrono_literals;
+    // a task waits 150ms in help_until: 50ms running a nested task, the rest parked. busy time must count the nested
+    // task once and leave the parked time to idle
+    threadpool pool({.threads = 1, .name = "nested"});
+    std::atomic<bool> released{false};
+    pool.schedule([&]()
+    {
+        pool.enqueue([]() { std::this_thread::sleep_for(50ms); });
+        std::thread releaser([&]() { std::this_thread::sleep_for(150ms); released = true; });
+        pool.help_until([&]() { return released.load(); });
+        releaser.join();
+    }).get();
+    if constexpr (telemetry_enabled)
+    {
+        // the outer task is recorded just after its future is set
+        auto w = pool.telemetry().workers[0];
+        for (int i = 0; i < 100 && w.tasks < 2; ++i, w = pool.telemetry().workers[0]) std::this_thread::sleep_for(1ms);
+        ASSERT_EQ(w.tasks, 2u);
+        ASSERT_GE(w.busy_ns, 50'000'000u);
+        ASSERT_LT(w.busy_ns, 100'000'000u);
+        ASSERT_GE(w.idle_ns, 50'000'000u);
+    }
+}
+
+// runs tasks of every lane on a single worker held busy until all of them are queued, returns the lanes in run order
+static std::vector<task_lane> lane_order(threadpool::config cfg)
+{
+    threadpool pool(cfg);
+    std::atomic<bool> release{false};
+    std::latch blocked(1);
+    pool.enqueue([&]() { blocked.count_down(); while (!release) std::this_thread::yield(); });
+    blocked.wait();
+    std::vector<task_lane> order;
+    std::latch done(15);
+    for (auto lane : {task_lane::low, task_lane::normal, task_lane::high})
+        for (int i = 0; i < 5; ++i)
+            pool.enqueue([&, lane]() { order.push_back(lane); done.count_down(); }, lane);
+    release = true;
+    done.wait();
+    return order;
+}
+
+TEST(threadpool, lanes)
+{
+    auto strict = lane_order({.threads = 1});
+    ASSERT_TRUE(std::is_sorted(strict.begin(), strict.end()));
+
+    // 2 high, 1 normal, 1 low turns per cycle: low work keeps moving while high work is queued
+    auto weighted = lane_order({.threads = 1, .lane_order = threadpool_lane_order::weighted, .lane_weights = {2, 1, 1}});
+    ASSERT_EQ(weighted.size(), 15u);
+    auto first_low = std::find(weighted.begin(), weighted.end(), task_lane::low);
+    auto last_high = std::find(weighted.rbegin(), weighted.rend(), task_lane::high).base();
+    ASSERT_TRUE(first_low < last_high);
+
+    // the reserved worker runs high lane work while the other one is stuck in a batch task
+    threadpool pool({.threads = 2, .reserved_workers = 1});
+    std::atomic<bool> release{false};
+    pool.enqueue([&]() { while (!release) std::this_thread::yield(); }, task_lane::low);
+    ASSERT_EQ(pool.schedule(task_lane::high, [](int x) { return x * 2; }, 21).get(), 42);
+    release = true;
+}
+
+TEST(threadpool, nested_parallel_for)
+{
+    // every worker ends up waiting inside a nested loop, each has to run queued chunks itself
+    threadpool pool({.threads = 2, .name = "nested"});
+    std::atomic<int> count{0};
+    parallel_for_chunks(8, [&](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; ++i)
+        {
+            parallel_for_chunks(8, [&](size_t b2, size_t e2)
+            {
+                for (size_t j = b2; j < e2; ++j)
+                    parallel_for_chunks(100, [&](size_t b3, size_t e3) { count += static_cast<int>(e3 - b3); }, 0, &pool);
+            }, 1, &pool);
+        }
+    }, 1, &pool);
+    ASSERT_EQ(count.load(), 8 * 8 * 100);
+}
+
+TEST(threadpool, helper_parks_while_waiting)
+{
+    using namespace std::chrono_literals;
+    // a worker waiting on a condition that another thread sets after a while must not spin through the whole wait
+    threadpool pool({.threads = 1, .name = "helper"});
+    std::atomic<bool> released{false};
+    std::thread releaser([&]() { std::this_thread::sleep_for(200ms); released = true; });
+    auto cpu_ms = pool.schedule([&]()
+    {
+        timespec start, end;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+        pool.help_until([&]() { return released.load(); });
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+        return (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    });
+    long cpu = cpu_ms.get();
+    releaser.join();
+    ASSERT_LT(cpu, 100);
+}
+
+TEST(threadpool, elastic)
+{
+    using namespace std::chrono_literals;
+    // no worker until the first task, growth only through blocking regions (growth_interval is out of reach)
+    threadpool pool({.threads = 3, .name = "elastic", .elastic = true, .min_threads = 1, .idle_timeout = 20ms, .growth_interval = 1h});
+    ASSERT_EQ(pool.size(), 3);
+    ASSERT_EQ(pool.threads(), 0);
+    ASSERT_EQ(pool.schedule([]() { return 1; }).get(), 1);
+    ASSERT_EQ(pool.threads(), 1);
+
+    // the only worker blocks on a task queued behind it, a replacement worker has to run that task. the thread count
+    // is read inside it, the replacement may already have retired by the time outer.get() returns
+    auto outer = pool.schedule([&pool]()
+    {
+        auto inner = pool.schedule([&pool]() { return pool.threads(); });
+        threadpool::blocking_region blocking;
+        return inner.get();
+    });
+    ASSERT_EQ(outer.get(), 2);
+
+    // idle workers retire down to min_threads and come back on demand
+    for (int i = 0; i < 200 && pool.threads() > 1; ++i) std::this_thread::sleep_for(5ms);
+    ASSERT_EQ(pool.threads(), 1);
+    std::atomic<int> count{0};
+    parallel_for_chunks(1000, [&](size_t b, size_t e) { count += static_cast<int>(e - b); }, 1, &pool);
+    ASSERT_EQ(count.load(), 1000);
+}
+
+TEST(threadpool, elastic_growth)
+{
+    // tasks that wait for each other without declaring it: the pool keeps growing while the queue is not drained
+    threadpool pool({.threads = 4, .name = "grow", .elastic = true});
+    std::latch together(4);
+    for (int i = 0; i < 4; ++i) pool.enqueue([&]() { together.arrive_and_wait(); });
+    together.wait();
+    ASSERT_EQ(pool.threads(), 4);
+}
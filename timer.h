@@ -0,0 +1,256 @@
+#pragma once
+#include "small_function.h"
+#include "pool_allocator.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// hierarchical timer wheel serviced by one thread (Varghese & Lauck): 4 levels of 256 slots, level l holds the
+// timers due in the current block of 256^(l+1) ticks, indexed by their tick >> 8l. adding a timer and firing one
+// are O(1), a timer moves down at most 3 times, and an idle wheel costs one wakeup per 256 ticks.
+// timers are pushed to an inbox under a mutex and only the timer thread touches the wheel. callbacks run on the
+// timer thread and must be short, threadpool::schedule_after only re-posts the task to a pool from there
+class timer_wheel
+{
+public:
+    using clock = std::chrono::steady_clock;
+    using callback = small_function<void()>;
+
+private:
+    struct timer
+    {
+        timer* next;
+        uint64_t deadline;  // in ticks since m_start
+        callback f;
+    };
+
+    static constexpr unsigned slot_bits = 8;
+    static constexpr uint64_t slot_count = 1u << slot_bits;
+    static constexpr uint64_t slot_mask = slot_count - 1;
+    static constexpr unsigned level_count = 4;
+
+    const clock::duration m_tick;
+    const clock::time_point m_start;
+
+    // owned by the timer thread
+    std::array<std::array<timer*, slot_count>, level_count> m_slots{};
+    timer* m_overflow = nullptr;                  // due beyond the top level, re-examined when it wraps
+    uint64_t m_now = 0;                           // last tick processed
+    size_t m_count = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    timer* m_inbox = nullptr;
+    bool m_stop = false;
+    std::atomic<size_t> m_pending{0};
+    std::thread m_thread;
+
+    static timer* allocate(uint64_t deadline, callback&& f)
+    {
+        return new (recycling_allocator<timer>{}.allocate(1)) timer{nullptr, deadline, std::move(f)};
+    }
+
+    static void release(timer* t)
+    {
+        t->~timer();
+        recycling_allocator<timer>{}.deallocate(t, 1);
+    }
+
+    // deadlines round up and the current tick rounds down, so that a timer never fires early
+    uint64_t deadline_of(clock::time_point when) const
+    {
+        if (when <= m_start) return 0;
+        return static_cast<uint64_t>((when - m_start + m_tick - clock::duration(1)) / m_tick);
+    }
+
+    uint64_t current_tick() const
+    {
+        return static_cast<uint64_t>((clock::now() - m_start) / m_tick);
+    }
+
+    static void push(timer*& list, timer* t)
+    {
+        t->next = list;
+        list = t;
+    }
+
+    // the lowest level whose current block contains the deadline, the slot index there is ahead of m_now
+    void insert(timer* t, timer*& expired)
+    {
+        if (t->deadline <= m_now)
+        {
+            push(expired, t);
+            return;
+        }
+        for (unsigned level = 0; level < level_count; ++level)
+        {
+            unsigned shift = slot_bits * (level + 1);
+            if ((t->deadline >> shift) == (m_now >> shift))
+            {
+                push(m_slots[level][(t->deadline >> (slot_bits * level)) & slot_mask], t);
+                return;
+            }
+        }
+        push(m_overflow, t);
+    }
+
+    void cascade(timer* list, timer*& expired)
+    {
+        while (list)
+        {
+            timer* next = list->next;
+            insert(list, expired);
+            list = next;
+        }
+    }
+
+    // moves m_now forward by one tick: higher level slots that start at the new tick are redistributed first,
+    // then everything left in the level 0 slot is due
+    void advance(timer*& expired)
+    {
+        ++m_now;
+        if ((m_now & slot_mask) == 0)
+        {
+            unsigned top = 1;
+            while (top < level_count && ((m_now >> (slot_bits * top)) & slot_mask) == 0) ++top;
+            if (top == level_count)
+            {
+                timer* overflow = std::exchange(m_overflow, nullptr);
+                cascade(overflow, expired);
+                top = level_count - 1;
+            }
+            for (unsigned level = top; level >= 1; --level)
+            {
+                auto& slot = m_slots[level][(m_now >> (slot_bits * level)) & slot_mask];
+                cascade(std::exchange(slot, nullptr), expired);
+            }
+        }
+        auto& slot = m_slots[0][m_now & slot_mask];
+        timer* due = std::exchange(slot, nullptr);
+        while (due)
+        {
+            timer* next = due->next;
+            push(expired, due);
+            due = next;
+        }
+    }
+
+    // tick to wake up at: the next non-empty level 0 slot of the current block, or the start of the next block
+    uint64_t next_wakeup() const
+    {
+        for (uint64_t tick = m_now + 1; (tick & slot_mask) != 0; ++tick)
+            if (m_slots[0][tick & slot_mask]) return tick;
+        return (m_now | slot_mask) + 1;
+    }
+
+    void fire(timer* expired)
+    {
+        while (expired)
+        {
+            timer* next = expired->next;
+            expired->f();
+            release(expired);
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+            --m_count;
+            expired = next;
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+        while (!m_stop)
+        {
+            timer* inbox = std::exchange(m_inbox, nullptr);
+            l.unlock();
+
+            uint64_t now = current_tick();
+            // nothing to fire on the way, skip the empty ticks instead of walking them
+            if (m_count == 0) m_now = std::max(m_now, now);
+            timer* expired = nullptr;
+            while (inbox)
+            {
+                timer* next = inbox->next;
+                insert(inbox, expired);
+                ++m_count;
+                inbox = next;
+            }
+            while (m_now < now) advance(expired);
+            fire(expired);
+
+            l.lock();
+            if (m_inbox || m_stop) continue;
+            if (m_count == 0) m_cv.wait(l, [this]() { return m_inbox || m_stop; });
+            else m_cv.wait_until(l, m_start + m_tick * next_wakeup(), [this]() { return m_inbox || m_stop; });
+        }
+    }
+
+public:
+    explicit timer_wheel(clock::duration tick = std::chrono::milliseconds(1)) : m_tick(tick), m_start(clock::now())
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    // timers that have not fired yet are dropped without running
+    ~timer_wheel()
+    {
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+        auto drop = [](timer* list)
+        {
+            while (list)
+            {
+                timer* next = list->next;
+                release(list);
+                list = next;
+            }
+        };
+        drop(m_inbox);
+        drop(m_overflow);
+        for (auto& level : m_slots)
+            for (timer* slot : level) drop(slot);
+    }
+
+    // wheel behind threadpool::schedule_after and sleep_for
+    static timer_wheel& instance()
+    {
+        static timer_wheel wheel;
+        return wheel;
+    }
+
+    // f runs on the timer thread once `when` has passed, at most one tick late plus scheduling delay
+    template<typename F>
+    void schedule_at(clock::time_point when, F&& f)
+    {
+        timer* t = allocate(deadline_of(when), callback(std::forward<F>(f)));
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        bool wake;
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            wake = m_inbox == nullptr;
+            push(m_inbox, t);
+        }
+        if (wake) m_cv.notify_one();
+    }
+
+    template<typename Rep, typename Period, typename F>
+    void schedule_after(std::chrono::duration<Rep, Period> delay, F&& f)
+    {
+        schedule_at(clock::now() + std::chrono::duration_cast<clock::duration>(delay), std::forward<F>(f));
+    }
+
+    size_t pending() const { return m_pending.load(std::memory_order_relaxed); }
+    clock::duration tick() const { return m_tick; }
+};
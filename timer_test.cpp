@@ -0,0 +1,93 @@
+#include "task.h"
+
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace std::chrono_literals;
+
+template<typename Pred>
+static bool wait_for(Pred pred, std::chrono::milliseconds timeout = 10s)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred())
+    {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+TEST(timer, wheel)
+{
+    // 10us ticks: delays up to 1.5s go through three levels of the wheel
+    timer_wheel wheel(10us);
+    const int n = 100000;
+    std::atomic<int> fired{0};
+    std::atomic<int> early{0};
+    std::mt19937 rng(7);
+    auto now = timer_wheel::clock::now();
+    for (int i = 0; i < n; ++i)
+    {
+        auto deadline = now + std::chrono::microseconds(i % 100 == 0 ? rng() % 1500000 : rng() % 200000);
+        wheel.schedule_at(deadline, [&, deadline]()
+        {
+            if (timer_wheel::clock::now() < deadline) early++;
+            fired++;
+        });
+    }
+    ASSERT_TRUE(wait_for([&]() { return fired.load() == n; }));
+    ASSERT_EQ(early.load(), 0);
+    ASSERT_EQ(wheel.pending(), 0u);
+
+    // past deadlines fire right away
+    std::atomic<bool> late{false};
+    wheel.schedule_at(now - 1s, [&]() { late = true; });
+    ASSERT_TRUE(wait_for([&]() { return late.load(); }, 1s));
+}
+
+TEST(timer, schedule_after)
+{
+    threadpool pool({.threads = 1});
+    std::atomic<int> order{0};
+    std::atomic<int> first{0}, second{0};
+    auto start = std::chrono::steady_clock::now();
+    pool.schedule_after(40ms, [&]() { second = ++order; });
+    pool.schedule_after(10ms, [&]() { first = ++order; });
+    ASSERT_TRUE(wait_for([&]() { return order.load() == 2; }));
+    ASSERT_EQ(first.load(), 1);
+    ASSERT_EQ(second.load(), 2);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, 40ms);
+}
+
+static async<void> nap(threadpool* pool, std::atomic<int>& woken)
+{
+    co_await sleep_for(50ms, pool);
+    woken++;
+}
+
+static async<int> nap_then(threadpool* pool, int value)
+{
+    co_await sleep_for(5ms, pool);
+    co_return value;
+}
+
+static async<void> awaits_nap(threadpool* pool, std::atomic<int>& result)
+{
+    result = co_await nap_then(pool, 41) + 1;
+}
+
+TEST(timer, sleep_for)
+{
+    // a single worker: sleeping coroutines must not hold it
+    threadpool pool({.threads = 1});
+    std::atomic<int> woken{0};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; ++i) nap(&pool, woken);
+    ASSERT_TRUE(wait_for([&]() { return woken.load() == 100; }));
+    ASSERT_LT(std::chrono::steady_clock::now() - start, 2s);
+
+    // the awaited coroutine finishes on a worker while the awaiting one may be suspending
+    std::atomic<int> result{0};
+    awaits_nap(&pool, result);
+    ASSERT_TRUE(wait_for([&]() { return result.load() == 42; }));
+}
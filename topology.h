@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// parses a linux cpu list such as "0-3,8,10-11"
+inline std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty() || !std::isdigit(static_cast<unsigned char>(item[0]))) continue;
+        size_t dash = item.find('-');
+        int first = std::stoi(item.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// cpus of every numa node from /sys/devices/system/node/node<N>/cpulist, indexed by node id
+// falls back to a single node holding every hardware thread when sysfs is not available
+inline std::vector<std::vector<int>> numa_nodes()
+{
+    std::vector<std::vector<int>> nodes;
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(static_cast<unsigned char>(name[4]))) continue;
+        size_t id = std::stoul(name.substr(4));
+        std::ifstream file(entry.path() / "cpulist");
+        std::string list;
+        if (!std::getline(file, list)) continue;
+        if (nodes.size() <= id) nodes.resize(id + 1);
+        nodes[id] = parse_cpu_list(list);
+    }
+    if (nodes.empty())
+    {
+        std::vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+        for (size_t i = 0; i < cpus.size(); ++i) cpus[i] = static_cast<int>(i);
+        nodes.push_back(std::move(cpus));
+    }
+    return nodes;
+}
+
+// restricts the calling thread to cpus, returns false when the platform or the kernel refuses
+inline bool pin_current_thread(const std::vector<int>& cpus)
+{
+#if defined(__linux__)
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// shows up in top/gdb/perf, linux truncates to 15 characters
+inline void name_current_thread(const std::string& name)
+{
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+}